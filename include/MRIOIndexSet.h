@@ -21,8 +21,11 @@
 #define LIBMRIO_MRIOINDEXSET_H
 
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #ifdef DEBUG
 #include <cassert>
@@ -112,83 +115,75 @@ class Region : public IndexPart<I> {
 
 template<typename I>
 class IndexSet {
+  public:
+    /**
+     * @brief Order in which (sector, region) combinations are laid out along the total indices
+     */
+    enum class Order {
+        REGION_MAJOR,  ///< regions outermost, subs expanded in place (order of input and output files)
+        SECTOR_MAJOR,  ///< sectors outermost, keeps subregions of a sector next to each other
+        CLUSTERED      ///< region-major on super level with all subs of a super (sector, region) next to each other
+    };
+
   private:
     I size_;
     I total_regions_count_;
     I total_sectors_count_;
-    std::unordered_map<std::string, Sector<I>*> sectors_map;
-    std::unordered_map<std::string, Region<I>*> regions_map;
+    std::unordered_map<std::string_view, Sector<I>*> sectors_map;  ///< keys view the names stored in the sectors themselves
+    std::unordered_map<std::string_view, Region<I>*> regions_map;  ///< keys view the names stored in the regions themselves
     std::vector<std::unique_ptr<Sector<I>>> supersectors_;
     std::vector<std::unique_ptr<Region<I>>> superregions_;
     std::vector<std::unique_ptr<Sector<I>>> subsectors_;
     std::vector<std::unique_ptr<Region<I>>> subregions_;
     std::vector<I> indices_;
+    std::vector<Sector<I>*> index_sectors_;  ///< (sub)sector of each total index
+    std::vector<Region<I>*> index_regions_;  ///< (sub)region of each total index
+    Order order_ = Order::REGION_MAJOR;
 
     void copy_pointers(const IndexSet<I>& other);
+    template<typename Func>
+    void for_each_index(Order order, Func func) const;
 
   public:
     static const I NOT_GIVEN;
+    struct Span {
+        I begin;
+        I size;
+    };
+    struct SpanRange {
+        const Span* begin_;
+        const Span* end_;
+        const Span* begin() const noexcept { return begin_; }
+        const Span* end() const noexcept { return end_; }
+    };
+
+  private:
+    std::vector<I> super_spans_offsets_;  ///< start of the spans of each super (sector, region) in super_spans_ (plus end)
+    std::vector<Span> super_spans_;       ///< contiguous total index ranges of all super (sector, region) combinations
+
+  public:
     class total_iterator {
       private:
-        const IndexSet& index_set;
+        const IndexSet* index_set;
         I index;
-        typename std::vector<Sector<I>*>::const_iterator supersector_it;
-        typename std::vector<std::unique_ptr<Region<I>>>::const_iterator superregion_it;
-        typename std::vector<Sector<I>*>::const_iterator subsector_it;
-        typename std::vector<Region<I>*>::const_iterator subregion_it;
-        explicit total_iterator(const IndexSet& index_set_p) : index_set(index_set_p), index(0) {}
 
       public:
         struct Index {
             const Sector<I>* sector;
             const Region<I>* region;
-            const I& index;
+            I index;
         };
-        static total_iterator begin(const IndexSet& index_set) {
-            total_iterator res(index_set);
-            res.superregion_it = index_set.superregions().begin();
-            if (res.superregion_it != index_set.superregions().end()) {
-                res.subregion_it = (*res.superregion_it)->sub().begin();
-                res.supersector_it = (*res.superregion_it)->sectors().begin();
-                if (res.supersector_it != (*res.superregion_it)->sectors().end()) {
-                    res.subsector_it = (*res.supersector_it)->sub().begin();
-                }
-            }
-            return res;
-        }
-        static total_iterator end(const IndexSet& index_set) {
-            total_iterator res(index_set);
-            res.superregion_it = index_set.superregions().end();
-            res.index = index_set.size();
-            return res;
-        }
+        total_iterator(const IndexSet* index_set_p, const I& index_p) : index_set(index_set_p), index(index_p) {}
         total_iterator operator++() {
-            if (subsector_it == (*supersector_it)->sub().end() || ++subsector_it == (*supersector_it)->sub().end()) {
-                if (supersector_it == (*superregion_it)->sectors().end() || ++supersector_it == (*superregion_it)->sectors().end()) {
-                    if (subregion_it == (*superregion_it)->sub().end() || ++subregion_it == (*superregion_it)->sub().end()) {
-                        if (superregion_it == index_set.superregions().end() || ++superregion_it == index_set.superregions().end()) {
-                            ++index;
-                            return *this;
-                        }
-                        subregion_it = (*superregion_it)->sub().begin();
-                    }
-                    supersector_it = (*superregion_it)->sectors().begin();
-                }
-                subsector_it = (*supersector_it)->sub().begin();
-            }
             ++index;
             return *this;
         }
-        const Index operator*() const {
-            return {(subsector_it == (*supersector_it)->sub().end()) ? static_cast<Sector<I>*>(*supersector_it) : static_cast<Sector<I>*>(*subsector_it),
-                    (subregion_it == (*superregion_it)->sub().end()) ? static_cast<Region<I>*>(superregion_it->get()) : static_cast<Region<I>*>(*subregion_it),
-                    index};
-        }
+        const Index operator*() const { return {index_set->index_sectors_[index], index_set->index_regions_[index], index}; }
         bool operator==(const total_iterator& rhs) const { return index == rhs.index; }
         bool operator!=(const total_iterator& rhs) const { return !(*this == rhs); }
     };
-    total_iterator tbegin() const { return total_iterator::begin(*this); }
-    total_iterator tend() const { return total_iterator::end(*this); }
+    total_iterator tbegin() const { return total_iterator(this, 0); }
+    total_iterator tend() const { return total_iterator(this, size_); }
     class TotalIndices {
       protected:
         const IndexSet& index_set;
@@ -265,21 +260,59 @@ class IndexSet {
     const std::vector<std::unique_ptr<Region<I>>>& superregions() const { return superregions_; }
     const std::vector<std::unique_ptr<Sector<I>>>& subsectors() const { return subsectors_; }
     const std::vector<std::unique_ptr<Region<I>>>& subregions() const { return subregions_; }
-    const Sector<I>* sector(const std::string& name) const { return sectors_map.at(name); }
-    const Region<I>* region(const std::string& name) const { return regions_map.at(name); }
+    const Sector<I>* sector(std::string_view name) const {
+        const Sector<I>* res = find_sector(name);
+        if (!res) {
+            throw std::out_of_range("Sector '" + std::string(name) + "' not found");
+        }
+        return res;
+    }
+    const Region<I>* region(std::string_view name) const {
+        const Region<I>* res = find_region(name);
+        if (!res) {
+            throw std::out_of_range("Region '" + std::string(name) + "' not found");
+        }
+        return res;
+    }
+    /**
+     * @brief Returns sector of given name or nullptr if not found
+     */
+    const Sector<I>* find_sector(std::string_view name) const noexcept {
+        const auto it = sectors_map.find(name);
+        return it == sectors_map.end() ? nullptr : it->second;
+    }
+    /**
+     * @brief Returns region of given name or nullptr if not found
+     */
+    const Region<I>* find_region(std::string_view name) const noexcept {
+        const auto it = regions_map.find(name);
+        return it == regions_map.end() ? nullptr : it->second;
+    }
     void clear();
     virtual ~IndexSet() { clear(); }
-    Sector<I>* add_sector(const std::string& name);
-    Region<I>* add_region(const std::string& name);
-    void add_index(const std::string& sector_name, const std::string& region_name);
+    Sector<I>* add_sector(std::string_view name);
+    Region<I>* add_region(std::string_view name);
+    void add_index(std::string_view sector_name, std::string_view region_name);
     void add_index(Sector<I>* sector_p, Region<I>* region_p);
     void rebuild_indices();
+    const Order& order() const { return order_; }
+    /**
+     * @brief Lays out the total indices in another order
+     */
+    void set_order(Order order_p) {
+        order_ = order_p;
+        rebuild_indices();
+    }
+    /**
+     * @brief Returns the total indices of this set in the sequence given by another order
+     */
+    std::vector<I> permutation(Order order) const;
     inline const I& at(const Sector<I>* sector_p, const Region<I>* region_p) const {
         assert(!sector_p->has_sub());
         assert(!region_p->has_sub());
         return indices_.at(*sector_p * total_regions_count_ + *region_p);
     }
-    inline const I& at(const std::string& sector_name, const std::string& region_name) const {
+    inline const I& at(std::string_view sector_name, std::string_view region_name) const {
         const Sector<I>* sector_ = sector(sector_name);
         const Region<I>* region_ = region(region_name);
         assert(!sector_->has_sub());
@@ -298,8 +331,51 @@ class IndexSet {
         assert(sector_index * total_regions_count_ + region_index < indices_.size());
         return indices_[sector_index * total_regions_count_ + region_index];
     }
+    /**
+     * @brief Returns (sub)sector of a total index
+     */
+    inline const Sector<I>* sector_of(const I& index) const noexcept {
+        assert(index < index_sectors_.size());
+        return index_sectors_[index];
+    }
+    /**
+     * @brief Returns (sub)region of a total index
+     */
+    inline const Region<I>* region_of(const I& index) const noexcept {
+        assert(index < index_regions_.size());
+        return index_regions_[index];
+    }
+    /**
+     * @brief Returns the contiguous ranges of total indices covered by a
+     *        super (sector, region) combination and its subs
+     */
+    inline SpanRange super_spans(const Sector<I>* sector_p, const Region<I>* region_p) const noexcept {
+        assert(!sector_p->is_sub());
+        assert(!region_p->is_sub());
+        const I position = sector_p->level_index() * superregions_.size() + region_p->level_index();
+        return {super_spans_.data() + super_spans_offsets_[position], super_spans_.data() + super_spans_offsets_[position + 1]};
+    }
     void insert_subsectors(const std::string& name, const std::vector<std::string>& newsubsectors);
     void insert_subregions(const std::string& name, const std::vector<std::string>& newsubregions);
+    /**
+     * @brief Returns range of total indices of a Sector-Region-Combination
+     *        (including all subs, nullptr meaning all), which has to be contiguous
+     *
+     * @param sector_p Sector or nullptr
+     * @param region_p Region or nullptr
+     * @return Pair of first index and number of indices
+     */
+    std::pair<I, I> range(const Sector<I>* sector_p, const Region<I>* region_p) const;
+    /**
+     * @brief Returns total indices of a Sector-Region-Combination (including
+     *        all subs, nullptr meaning all) as sorted contiguous spans,
+     *        collected from the super spans
+     *
+     * @param sector_p Sector or nullptr
+     * @param region_p Region or nullptr
+     * @return Spans of total indices
+     */
+    std::vector<Span> spans(const Sector<I>* sector_p, const Region<I>* region_p) const;
 
     void debug_out() const {
 #ifdef LIBMRIO_VERBOSE
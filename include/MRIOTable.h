@@ -20,12 +20,18 @@
 #ifndef LIBMRIO_MRIOTABLE_H
 #define LIBMRIO_MRIOTABLE_H
 
+#include <algorithm>
 #include <iosfwd>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include "MRIOIndexSet.h"
+#include "allocator.h"
+#include "kernels.h"
 #ifdef DEBUG
 #include <cassert>
 #else
@@ -36,11 +42,89 @@
 
 namespace mrio {
 
+/**
+ * @brief Type sums of values of type T are accumulated in (double for float storage)
+ */
+template<typename T>
+struct Accumulator {
+    using type = T;
+};
+template<>
+struct Accumulator<float> {
+    using type = double;
+};
+
+/**
+ * @brief Sums size contiguous values by pairwise summation of vectorized
+ *        chunks, so that the rounding error grows only logarithmically
+ */
+template<typename A, typename T, typename I>
+inline A pairwise_sum(const T* values, const I& size) noexcept {
+    if (size <= 256) {
+        if constexpr (std::is_same<A, double>::value && std::is_floating_point<T>::value && sizeof(T) <= sizeof(double)) {
+            return kernels::sum(values, size);
+        } else {
+            A res = 0;
+#pragma omp simd reduction(+ : res)
+            for (I x = 0; x < size; ++x) {
+                res += values[x];
+            }
+            return res;
+        }
+    }
+    const I half = size / 2;
+    return pairwise_sum<A>(values, half) + pairwise_sum<A>(values + half, size - half);
+}
+
+/**
+ * @brief Non-owning view of a rectangular block of a Table, rows being
+ *        contiguous spans of cols() values that are stride() apart
+ */
+template<typename T, typename I>
+class BlockView {
+  protected:
+    T* begin_;
+    I rows_;
+    I cols_;
+    I stride_;
+
+  public:
+    BlockView(T* begin_p, const I& rows_p, const I& cols_p, const I& stride_p) noexcept : begin_(begin_p), rows_(rows_p), cols_(cols_p), stride_(stride_p) {}
+    inline const I& rows() const noexcept { return rows_; }
+    inline const I& cols() const noexcept { return cols_; }
+    inline const I& stride() const noexcept { return stride_; }
+    inline T* data() const noexcept { return begin_; }
+    inline T* row(const I& y) const noexcept {
+        assert(y < rows_);
+        return begin_ + y * stride_;
+    }
+    inline T& operator()(const I& y, const I& x) const noexcept {
+        assert(y < rows_);
+        assert(x < cols_);
+        return begin_[y * stride_ + x];
+    }
+    inline BlockView block(const I& row_begin, const I& rows_p, const I& col_begin, const I& cols_p) const noexcept {
+        assert(row_begin + rows_p <= rows_);
+        assert(col_begin + cols_p <= cols_);
+        return BlockView(begin_ + row_begin * stride_ + col_begin, rows_p, cols_p, stride_);
+    }
+};
+
 template<typename T, typename I>
 class Table {
+  public:
+    using accumulator_type = typename Accumulator<T>::type;
+    using data_type = std::vector<T, ZeroAllocator<T>>;  ///< zero-initialised values are not written on allocation (grow by resize_zeroed only)
+
   protected:
-    std::vector<T> data;
-    IndexSet<I> index_set_;
+    data_type data;
+    std::shared_ptr<const IndexSet<I>> index_set_;  ///< frozen once held, shared between copies of this table and derived tables
+    std::vector<accumulator_type> aggregate_blocks;  ///< sums of blocks (super i, super r)->(super j, super s) (empty if aggregate index not built)
+    std::vector<accumulator_type> aggregate_rows;    ///< sums of all flows from (super i, super r)
+    std::vector<accumulator_type> aggregate_cols;    ///< sums of all flows to (super j, super s)
+    std::vector<std::vector<typename IndexSet<I>::Span>> sum_plans;  ///< spans for each (sector, region) argument pair of sum() (empty if not built)
+    std::vector<accumulator_type> row_totals_;  ///< sums of all flows from each index (empty if marginals not maintained)
+    std::vector<accumulator_type> col_totals_;  ///< sums of all flows to each index (empty if marginals not maintained)
 
     void read_indices_from_csv(std::istream& indicesstream);
     void read_data_from_csv(std::istream& datastream, const T& threshold);
@@ -56,29 +140,100 @@ class Table {
                                          const I& divide_by,
                                          const I& first_index,
                                          const I& last_index) noexcept;
+    void relayout(std::shared_ptr<const IndexSet<I>> new_index_set, bool in_place);
 
+    inline I super_position(const Sector<I>* i, const Region<I>* r) const noexcept {
+        assert(!i->is_sub());
+        assert(!r->is_sub());
+        return i->level_index() * index_set_->superregions().size() + r->level_index();
+    }
+    inline I sum_plan_key(const Sector<I>* i, const Region<I>* r) const noexcept {
+        const I i_key = i == nullptr ? 0 : (i->is_sub() ? 1 + index_set_->supersectors().size() + i->level_index() : 1 + i->level_index());
+        const I r_key = r == nullptr ? 0 : (r->is_sub() ? 1 + index_set_->superregions().size() + r->level_index() : 1 + r->level_index());
+        return i_key * (1 + index_set_->superregions().size() + index_set_->subregions().size()) + r_key;
+    }
+    void add_block_to_marginals(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s, const T& factor);
+    accumulator_type planned_sum(const std::vector<typename IndexSet<I>::Span>& rows, const std::vector<typename IndexSet<I>::Span>& cols) const noexcept;
+    accumulator_type aggregated_sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
+    void add_leaf_sum(accumulator_type& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
     template<bool use_base>
-    void build_sum_source(T& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
+    void build_sum_source(accumulator_type& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
     template<bool use_base, typename Arg_i, typename Arg_r>
-    void build_sum_target(T& res, Arg_i&& i, Arg_r&& r, const Sector<I>* j, const Region<I>* s) const noexcept;
+    void build_sum_target(accumulator_type& res, Arg_i&& i, Arg_r&& r, const Sector<I>* j, const Region<I>* s) const noexcept;
     template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-    void add_sum(T& res, const std::vector<Arg1*>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
+    void add_sum(accumulator_type& res, const std::vector<Arg1*>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
     template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-    void add_sum(T& res, const std::vector<std::unique_ptr<Arg1>>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
+    void add_sum(accumulator_type& res, const std::vector<std::unique_ptr<Arg1>>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
     template<bool use_base, int c, typename Arg3, typename Arg4>
-    void add_sum(T& res, const std::vector<std::unique_ptr<Sector<I>>>& arg1, bool, Arg3&& arg3, Arg4&& arg4) const noexcept;
+    void add_sum(accumulator_type& res, const std::vector<std::unique_ptr<Sector<I>>>& arg1, bool, Arg3&& arg3, Arg4&& arg4) const noexcept;
     template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-    void add_sum(T& res, const Arg1* arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
+    void add_sum(accumulator_type& res, const Arg1* arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept;
 
   public:
-    Table() {}
-    explicit Table(const IndexSet<I>& index_set_p, const T default_value_p = std::numeric_limits<T>::signaling_NaN()) : index_set_(index_set_p) {
-        data.resize(index_set_.size() * index_set_.size(), default_value_p);
-    }
-    inline const IndexSet<I>& index_set() const { return index_set_; }
-    void insert_subsectors(const std::string& name, const std::vector<std::string>& subsectors);
-    void insert_subregions(const std::string& name, const std::vector<std::string>& subregions);
-    void write_to_csv(std::ostream& indicesstream, std::ostream& datastream) const;
+    Table() : index_set_(std::make_shared<const IndexSet<I>>()) {}
+    explicit Table(const IndexSet<I>& index_set_p, const T default_value_p = std::numeric_limits<T>::signaling_NaN())
+        : Table(std::make_shared<const IndexSet<I>>(index_set_p), default_value_p) {}
+    /**
+     * @brief Creates table on an IndexSet shared with other tables (without copying it)
+     */
+    explicit Table(std::shared_ptr<const IndexSet<I>> index_set_p, const T default_value_p = std::numeric_limits<T>::signaling_NaN())
+        : index_set_(std::move(index_set_p)) {
+        resize_zeroed(data, index_set_->size() * index_set_->size());  // zeroed and not touched yet
+        if (default_value_p != 0) {
+            const I n = index_set_->size();
+            // fill rows in parallel so that their pages are first touched by the threads later working on them
+#pragma omp parallel for default(shared) schedule(static)
+            for (std::size_t y = 0; y < n; ++y) {
+                std::fill(&data[y * n], &data[y * n] + n, default_value_p);
+            }
+        }
+    }
+    inline const IndexSet<I>& index_set() const { return *index_set_; }
+    inline const std::shared_ptr<const IndexSet<I>>& shared_index_set() const { return index_set_; }
+    /**
+     * @brief Inserts subsectors for a sector, distributing values equally
+     *
+     * @param in_place Shift values within the (resized) data serially instead
+     *        of filling a new matrix in parallel, which temporarily needs
+     *        memory for both
+     */
+    void insert_subsectors(const std::string& name, const std::vector<std::string>& subsectors, bool in_place = true);
+    /**
+     * @brief Inserts subregions for a region, distributing values equally
+     *
+     * @param in_place See insert_subsectors
+     */
+    void insert_subregions(const std::string& name, const std::vector<std::string>& subregions, bool in_place = true);
+    /**
+     * @brief Relayouts table to an IndexSet that results from this table's
+     *        IndexSet by inserting subsectors and subregions (in one pass for
+     *        all of them), distributing values equally
+     *
+     * @param new_index_set Disaggregated IndexSet (possibly in another order)
+     * @param in_place See insert_subsectors (not possible when changing the order)
+     */
+    void insert_subs_from(const IndexSet<I>& new_index_set, bool in_place = true);
+    void insert_subs_from(std::shared_ptr<const IndexSet<I>> new_index_set, bool in_place = true);
+    /**
+     * @brief Relayouts table to another order of its total indices (files
+     *        are still read and written region-major)
+     */
+    void set_index_order(typename IndexSet<I>::Order order);
+    /**
+     * @brief Returns table aggregated to a coarser classification in one
+     *        parallel pass over the values
+     *
+     * @param sector_map Maps names of (sub)sectors to names of aggregated sectors (names not contained are kept)
+     * @param region_map Maps names of (sub)regions to names of aggregated regions (names not contained are kept)
+     * @return Aggregated table (without subs)
+     */
+    Table aggregate(const std::unordered_map<std::string, std::string>& sector_map, const std::unordered_map<std::string, std::string>& region_map) const;
+    /**
+     * @brief Writes indices and values as csv
+     *
+     * @param region_major Write region-major (as read) instead of in the index order used during computation
+     */
+    void write_to_csv(std::ostream& indicesstream, std::ostream& datastream, bool region_major = true) const;
     void write_to_mrio(std::ostream& outstream) const;
 #ifdef LIBMRIO_WITH_NETCDF
     void write_to_netcdf(const std::string& filename) const;
@@ -89,50 +244,111 @@ class Table {
     void read_from_netcdf(const std::string& filename, const T& threshold);
 #endif
 
-    T sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
-    T basesum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
+    /**
+     * @brief Sum over the given block (nullptr meaning all), returned unrounded in accumulator precision
+     */
+    accumulator_type sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
+    /**
+     * @brief Builds index of sums over blocks of super sectors/regions, so that
+     *        sum() with only nullptr or super arguments does not need to visit
+     *        every value; has to be kept up to date via update_aggregate_index
+     *        when values change (stays valid on inserting subsectors/subregions)
+     */
+    void build_aggregate_index();
+    /**
+     * @brief Updates aggregate index for block (i,r)->(j,s) of super sectors/regions
+     *        after its values have changed (can be called concurrently for different blocks)
+     */
+    void update_aggregate_index(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) noexcept;
+    void clear_aggregate_index();
+    inline bool has_aggregate_index() const noexcept { return !aggregate_blocks.empty(); }
+    /**
+     * @brief Compiles every possible (sector, region) argument pair of sum()
+     *        into contiguous index spans, so that sum() only needs to reduce
+     *        over these; has to be rebuilt when subsectors/subregions are inserted
+     */
+    void build_sum_plans();
+    void clear_sum_plans();
+    inline bool has_sum_plans() const noexcept { return !sum_plans.empty(); }
+    /**
+     * @brief Builds row and column totals of every index, which are kept up to
+     *        date on inserting subsectors/subregions; changing values of a block
+     *        has to be enclosed by remove_from_marginals and add_to_marginals
+     */
+    void build_marginals();
+    void clear_marginals();
+    inline bool has_marginals() const noexcept { return !row_totals_.empty(); }
+    inline const std::vector<accumulator_type>& row_totals() const noexcept { return row_totals_; }
+    inline const std::vector<accumulator_type>& col_totals() const noexcept { return col_totals_; }
+    inline const accumulator_type& row_total(const I& from) const noexcept {
+        assert(from < row_totals_.size());
+        return row_totals_[from];
+    }
+    inline const accumulator_type& col_total(const I& to) const noexcept {
+        assert(to < col_totals_.size());
+        return col_totals_[to];
+    }
+    /**
+     * @brief Removes values of super block (i,r)->(j,s) from marginals (if maintained)
+     *        before they are changed (can be called concurrently for different blocks)
+     */
+    inline void remove_from_marginals(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
+        if (has_marginals()) {
+            add_block_to_marginals(i, r, j, s, -1);
+        }
+    }
+    /**
+     * @brief Adds values of super block (i,r)->(j,s) to marginals (if maintained)
+     *        after they have been changed (can be called concurrently for different blocks)
+     */
+    inline void add_to_marginals(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
+        if (has_marginals()) {
+            add_block_to_marginals(i, r, j, s, 1);
+        }
+    }
+    accumulator_type basesum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept;
 
     inline T& at(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-        assert(index_set_.at(i, r) >= 0);
-        assert(index_set_.at(j, s) >= 0);
-        return at(index_set_.at(i, r), index_set_.at(j, s));
+        assert(index_set_->at(i, r) >= 0);
+        assert(index_set_->at(j, s) >= 0);
+        return at(index_set_->at(i, r), index_set_->at(j, s));
     }
     inline const T& at(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const {
-        assert(index_set_.at(i, r) >= 0);
-        assert(index_set_.at(j, s) >= 0);
-        return at(index_set_.at(i, r), index_set_.at(j, s));
+        assert(index_set_->at(i, r) >= 0);
+        assert(index_set_->at(j, s) >= 0);
+        return at(index_set_->at(i, r), index_set_->at(j, s));
     }
     inline T& operator()(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) noexcept {
-        assert(index_set_.at(i, r) >= 0);
-        assert(index_set_.at(j, s) >= 0);
-        return (*this)(index_set_(i, r), index_set_(j, s));
+        assert(index_set_->at(i, r) >= 0);
+        assert(index_set_->at(j, s) >= 0);
+        return (*this)((*index_set_)(i, r), (*index_set_)(j, s));
     }
     inline const T& operator()(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
-        assert(index_set_.at(i, r) >= 0);
-        assert(index_set_.at(j, s) >= 0);
-        return (*this)(index_set_(i, r), index_set_(j, s));
+        assert(index_set_->at(i, r) >= 0);
+        assert(index_set_->at(j, s) >= 0);
+        return (*this)((*index_set_)(i, r), (*index_set_)(j, s));
     }
     inline T& at(const I& from, const I& to) {
         assert(from >= 0);
         assert(to >= 0);
-        return data.at(from * index_set_.size() + to);
+        return data.at(from * index_set_->size() + to);
     }
     inline const T& at(const I& from, const I& to) const {
         assert(from >= 0);
         assert(to >= 0);
-        return data.at(from * index_set_.size() + to);
+        return data.at(from * index_set_->size() + to);
     }
     inline T& operator()(const I& from, const I& to) noexcept {
         assert(from >= 0);
         assert(to >= 0);
-        assert(from * index_set_.size() + to < data.size());
-        return data[from * index_set_.size() + to];
+        assert(from * index_set_->size() + to < data.size());
+        return data[from * index_set_->size() + to];
     }
     inline const T& operator()(const I& from, const I& to) const noexcept {
         assert(from >= 0);
         assert(to >= 0);
-        assert(from * index_set_.size() + to < data.size());
-        return data[from * index_set_.size() + to];
+        assert(from * index_set_->size() + to < data.size());
+        return data[from * index_set_->size() + to];
     }
     /**
      * @brief Returns reference to value with Sectors/Regions of a foreign Table
@@ -141,17 +357,45 @@ class Table {
      * @return Reference to value
      */
     inline T& base(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) noexcept {
-        assert(index_set_.base(i, r) >= 0);
-        assert(index_set_.base(j, s) >= 0);
-        return (*this)(index_set_.base(i, r), index_set_.base(j, s));
+        assert(index_set_->base(i, r) >= 0);
+        assert(index_set_->base(j, s) >= 0);
+        return (*this)(index_set_->base(i, r), index_set_->base(j, s));
     }
     inline const T& base(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
-        assert(index_set_.base(i, r) >= 0);
-        assert(index_set_.base(j, s) >= 0);
-        return (*this)(index_set_.base(i, r), index_set_.base(j, s));
+        assert(index_set_->base(i, r) >= 0);
+        assert(index_set_->base(j, s) >= 0);
+        return (*this)(index_set_->base(i, r), index_set_->base(j, s));
     }
-    void replace_table_from(const Table& other) { data = other.data; }
-    const std::vector<T>& raw_data() const { return data; }
+    inline BlockView<T, I> block(const I& row_begin, const I& rows, const I& col_begin, const I& cols) noexcept {
+        assert((row_begin + rows) * index_set_->size() <= data.size());
+        assert(col_begin + cols <= index_set_->size());
+        return BlockView<T, I>(data.data() + row_begin * index_set_->size() + col_begin, rows, cols, index_set_->size());
+    }
+    inline BlockView<const T, I> block(const I& row_begin, const I& rows, const I& col_begin, const I& cols) const noexcept {
+        assert((row_begin + rows) * index_set_->size() <= data.size());
+        assert(col_begin + cols <= index_set_->size());
+        return BlockView<const T, I>(data.data() + row_begin * index_set_->size() + col_begin, rows, cols, index_set_->size());
+    }
+    /**
+     * @brief Returns view of block (i,r)->(j,s) including all subs (nullptr
+     *        meaning all), e.g. (nullptr,r)->(nullptr,s) for a region block;
+     *        indices of (i,r) and (j,s) have to be contiguous (see IndexSet::range)
+     */
+    inline BlockView<T, I> block(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
+        const auto from = index_set_->range(i, r);
+        const auto to = index_set_->range(j, s);
+        return block(from.first, from.second, to.first, to.second);
+    }
+    inline BlockView<const T, I> block(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const {
+        const auto from = index_set_->range(i, r);
+        const auto to = index_set_->range(j, s);
+        return block(from.first, from.second, to.first, to.second);
+    }
+    /**
+     * @brief Copies values of other table (with same indices) row-wise in parallel
+     */
+    void replace_table_from(const Table& other);
+    const data_type& raw_data() const { return data; }
     void debug_out() const;
 };
 }  // namespace mrio
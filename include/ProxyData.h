@@ -23,11 +23,16 @@
 #ifdef LIBMRIO_VERBOSE
 #include <iostream>
 #endif
+#include <cstdint>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
+#include "allocator.h"
 
 namespace csv {
 class Parser;
@@ -56,6 +61,51 @@ struct FullIndex {
     const Region<I>* s;
 };
 
+/**
+ * @brief Lazily generated list of all super index combinations (i,r)->(j,s)
+ *        in which at least one side is disaggregated
+ *
+ * Only the super (sector, region) combinations are stored, the k-th FullIndex
+ * is computed on access from 32-bit positions into these.
+ */
+template<typename I>
+class FullIndices {
+  protected:
+    struct SuperIndex {
+        const Sector<I>* sector;
+        const Region<I>* region;
+    };
+    std::vector<SuperIndex> supers;
+    std::vector<std::uint32_t> disaggregated;      ///< positions in supers having subsectors or subregions
+    std::vector<std::uint32_t> non_disaggregated;  ///< all other positions in supers
+    std::size_t disaggregated_rows_size;           ///< number of combinations with disaggregated (i,r)
+    std::vector<bool> occupied_;                   ///< whether base flow of k-th combination is non-zero (empty if not known)
+
+  public:
+    explicit FullIndices(const IndexSet<I>& index_set);
+    template<typename T>
+    FullIndices(const IndexSet<I>& index_set, const Table<T, I>& basetable);
+    inline std::size_t size() const noexcept { return disaggregated_rows_size + non_disaggregated.size() * disaggregated.size(); }
+    /**
+     * @brief Returns whether the k-th combination can be non-zero, i.e. its
+     *        base flow is not zero (always true if no basetable was given)
+     */
+    inline bool occupied(std::size_t k) const noexcept { return occupied_.empty() || occupied_[k]; }
+    inline FullIndex<I> operator[](std::size_t k) const noexcept {
+        std::uint32_t from;
+        std::uint32_t to;
+        if (k < disaggregated_rows_size) {
+            from = disaggregated[k / supers.size()];
+            to = k % supers.size();
+        } else {
+            k -= disaggregated_rows_size;
+            from = non_disaggregated[k / disaggregated.size()];
+            to = disaggregated[k % disaggregated.size()];
+        }
+        return {supers[from].sector, supers[from].region, supers[to].sector, supers[to].region};
+    }
+};
+
 template<typename T, typename I, typename Func>
 inline void do_for_all_sub(Func func, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
     func(i, r, j, s);
@@ -97,6 +147,20 @@ inline void for_all_sub(const Sector<I>* i, const Arguments&... params) {
     }
 }
 
+/**
+ * @brief Calls func(rows, cols) for all pairs of contiguous total index ranges
+ *        covering the block (super i, super r)->(super j, super s)
+ */
+template<typename I, typename Func>
+inline void for_all_sub_spans(const IndexSet<I>& index_set, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s, Func func) {
+    const auto cols = index_set.super_spans(j, s);
+    for (const auto& rows : index_set.super_spans(i, r)) {
+        for (const auto& col : cols) {
+            func(rows, col);
+        }
+    }
+}
+
 template<typename T, typename I>
 class ProxyData {
   protected:
@@ -132,7 +196,8 @@ class ProxyData {
         std::size_t size;
         std::vector<std::unique_ptr<MappingIndexPart>> native_indices;
         std::vector<std::unique_ptr<MappingIndexPart>> foreign_indices;
-        std::unordered_map<std::string, MappingIndexPart*> foreign_indices_map;
+        std::deque<std::string> foreign_names;                                        ///< names of foreign_indices (deque, so that they do not move)
+        std::unordered_map<std::string_view, MappingIndexPart*> foreign_indices_map;  ///< keys view the names in foreign_names
     };
     struct Column {
         enum class Type { SELECT, IGNORE, VALUE, INDEX };
@@ -148,8 +213,9 @@ class ProxyData {
         Application() = default;
         Application(Application* application1, Application* application2);
         Application(ProxyIndex* i_p, ProxyIndex* r_p, ProxyIndex* j_p, ProxyIndex* s_p) : i(i_p), r(r_p), j(j_p), s(s_p) {}
-        inline T get_flow(const Table<T, I>& table, const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const;
-        inline T get_flow_share_denominator(
+        inline typename Table<T, I>::accumulator_type get_flow(
+            const Table<T, I>& table, const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const;
+        inline typename Table<T, I>::accumulator_type get_flow_share_denominator(
             const Table<T, I>& table, const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const;
         inline bool applies_to(const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const {
             return (i == nullptr || i->sub == i_p->has_sub()) && (r == nullptr || r->sub == r_p->has_sub()) && (j == nullptr || j->sub == j_p->has_sub())
@@ -162,10 +228,11 @@ class ProxyData {
 #endif
     };
 
-    std::vector<T> data;
+    std::vector<T, ZeroAllocator<T>> data;
     std::vector<std::unique_ptr<ProxyIndex>> indices;
     std::vector<std::unique_ptr<Application>> applications;
-    const IndexSet<I> table_indices;
+    const std::shared_ptr<const IndexSet<I>> table_indices_ptr;  ///< keeps the (possibly shared) index set alive
+    const IndexSet<I>& table_indices;
 
     static void set_clusters_for_native(MappingIndexPart* native_index_part);
     static void set_clusters_for_foreign(MappingIndexPart* foreign_index_part);
@@ -193,14 +260,30 @@ class ProxyData {
                                                  const Region<I>* s_p) const;
     inline Application* find_application_from(std::size_t& index, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const;
     void read_mapping_from_file(const settings::SettingsNode& mapping_node, ProxyIndex& index);
+    static constexpr std::size_t NOT_FOUND = std::numeric_limits<std::size_t>::max();
+    /**
+     * @brief Returns position of a (mapped or native) name in a proxy index or NOT_FOUND
+     */
+    std::size_t find_index(const ProxyIndex& index, std::string_view name) const noexcept;
+    inline void approximate_block(
+        const FullIndex<I>& full_index, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& last_table, std::uint8_t d) const;
+    inline void adjust_block(
+        const FullIndex<I>& full_index, Table<T, I>& table, const Table<std::uint8_t, I>& quality, const Table<T, I>& basetable, std::uint8_t d) const;
 
   public:
-    explicit ProxyData(IndexSet<I> table_indices_p) : table_indices(std::move(table_indices_p)) {}
+    explicit ProxyData(std::shared_ptr<const IndexSet<I>> table_indices_p) : table_indices_ptr(std::move(table_indices_p)), table_indices(*table_indices_ptr) {}
+    explicit ProxyData(const IndexSet<I>& table_indices_p) : ProxyData(std::make_shared<const IndexSet<I>>(table_indices_p)) {}
     void read_from_file(const settings::SettingsNode& settings_node);
     void approximate(
-        const std::vector<FullIndex<I>>& full_indices, Table<T, I>& table, Table<std::size_t, I> quality, const Table<T, I>& last_table, std::size_t d) const;
+        const FullIndices<I>& full_indices, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& last_table, std::uint8_t d) const;
     void adjust(
-        const std::vector<FullIndex<I>>& full_indices, Table<T, I>& table, Table<std::size_t, I> quality, const Table<T, I>& basetable, std::size_t d) const;
+        const FullIndices<I>& full_indices, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& basetable, std::uint8_t d) const;
+    void approximate_and_adjust(const FullIndices<I>& full_indices,
+                                Table<T, I>& table,
+                                Table<std::uint8_t, I>& quality,
+                                const Table<T, I>& last_table,
+                                const Table<T, I>& basetable,
+                                std::uint8_t d) const;
 };
 }  // namespace mrio
 
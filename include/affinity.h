@@ -0,0 +1,51 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_AFFINITY_H
+#define LIBMRIO_AFFINITY_H
+
+namespace mrio {
+
+enum class MemoryPolicy {
+    FIRST_TOUCH,  ///< pages are placed on the NUMA node of the thread first writing them (system default)
+    INTERLEAVE    ///< pages are spread round-robin over all online NUMA nodes
+};
+
+enum class ThreadAffinity {
+    NONE,   ///< threads are placed by the system
+    CLOSE,  ///< OpenMP worker thread k is bound to the k-th allowed CPU
+    SPREAD  ///< OpenMP worker threads are bound to allowed CPUs alternating between NUMA nodes
+};
+
+/**
+ * @brief Sets memory policy of the calling thread and the OpenMP threads
+ *        (has to be called before large allocations)
+ */
+void set_memory_policy(MemoryPolicy policy);
+
+/**
+ * @brief Binds the OpenMP worker threads to CPUs, the calling thread keeps
+ *        its CPU mask (the number of OpenMP threads must not change
+ *        afterwards, as newly created threads are not bound)
+ */
+void set_thread_affinity(ThreadAffinity affinity);
+
+}  // namespace mrio
+
+#endif
@@ -0,0 +1,108 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_ALLOCATOR_H
+#define LIBMRIO_ALLOCATOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mrio {
+
+/**
+ * @brief Returns zeroed memory of given size (large blocks are mapped
+ *        anonymously, so that their pages only materialise on first write)
+ */
+void* allocate_zeroed(std::size_t size);
+void deallocate_zeroed(void* p, std::size_t size) noexcept;
+
+/**
+ * @brief Sets whether large blocks allocated afterwards are aligned to 2 MB
+ *        and marked for transparent huge pages (ignored where these are not
+ *        available)
+ */
+void set_huge_pages(bool enabled) noexcept;
+bool huge_pages() noexcept;
+
+/**
+ * @brief Allocator for large value buffers handing out zeroed memory, so
+ *        that value-initialising arithmetic elements does not touch it
+ *
+ * Arithmetic elements constructed without a value are left as they are,
+ * which is only zero in freshly allocated memory. Hence, vectors using
+ * this allocator have to be grown by resize_zeroed instead of resize(n)
+ * or emplace_back() (which would keep stale values when growing within
+ * their capacity).
+ */
+template<typename T>
+class ZeroAllocator {
+  public:
+    using value_type = T;
+
+    ZeroAllocator() noexcept = default;
+    template<typename U>
+    ZeroAllocator(const ZeroAllocator<U>& /* other */) noexcept {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(allocate_zeroed(n * sizeof(T))); }
+    void deallocate(T* p, std::size_t n) noexcept { deallocate_zeroed(p, n * sizeof(T)); }
+
+    template<typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        if constexpr (!std::is_arithmetic<U>::value) {
+            ::new (static_cast<void*>(p)) U();
+        }
+        // arithmetic values are value-initialised to zero already
+    }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template<typename T, typename U>
+inline bool operator==(const ZeroAllocator<T>& /* lhs */, const ZeroAllocator<U>& /* rhs */) noexcept {
+    return true;
+}
+
+template<typename T, typename U>
+inline bool operator!=(const ZeroAllocator<T>& /* lhs */, const ZeroAllocator<U>& /* rhs */) noexcept {
+    return false;
+}
+
+/**
+ * @brief Resizes values to size n with new values being zero, writing them
+ *        only if they are placed in memory used before
+ */
+template<typename T>
+inline void resize_zeroed(std::vector<T, ZeroAllocator<T>>& values, std::size_t n) {
+    const std::size_t old_size = values.size();
+    const bool reallocates = n > values.capacity();
+    values.resize(n);
+    if (!reallocates && n > old_size) {
+        std::fill(std::begin(values) + old_size, std::end(values), T());
+    }
+}
+
+}  // namespace mrio
+
+#endif
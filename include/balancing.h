@@ -0,0 +1,46 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_BALANCING_H
+#define LIBMRIO_BALANCING_H
+
+#include <vector>
+
+namespace mrio {
+
+template<typename T, typename I>
+class Table;
+
+/**
+ * @brief Balances table in place to given row and column totals by GRAS
+ *        (which equals RAS for non-negative tables)
+ *
+ * @param table Table to balance
+ * @param row_totals Target total of each row
+ * @param col_totals Target total of each column
+ * @param tolerance Balancing stops when all row and column totals deviate from their targets by at most this fraction
+ * @param max_iterations Maximum number of row and column sweeps
+ * @return Number of sweeps needed
+ */
+template<typename T, typename I>
+I balance(Table<T, I>& table, const std::vector<T>& row_totals, const std::vector<T>& col_totals, const T& tolerance, const I& max_iterations);
+
+}  // namespace mrio
+
+#endif
@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_KERNELS_H
+#define LIBMRIO_KERNELS_H
+
+#include <cstddef>
+
+namespace mrio {
+namespace kernels {
+
+// Kernels for float and double are compiled for several instruction sets
+// (AVX-512, AVX2 and SSE2 as baseline) and dispatched at runtime when
+// LIBMRIO_SIMD_DISPATCH is set; these templates cover other types.
+
+/**
+ * @brief Returns sum of size values
+ */
+double sum(const float* values, std::size_t size) noexcept;
+double sum(const double* values, std::size_t size) noexcept;
+
+/**
+ * @brief Writes size values of from divided by divisor to to, which may
+ *        overlap with from if it does not start before it (values are
+ *        handled from the end)
+ */
+void divide(const float* from, float* to, std::size_t size, float divisor) noexcept;
+void divide(const double* from, double* to, std::size_t size, double divisor) noexcept;
+template<typename T>
+inline void divide(const T* from, T* to, std::size_t size, const T& divisor) noexcept {
+    for (std::size_t k = size; k-- > 0;) {
+        to[k] = from[k] / divisor;
+    }
+}
+
+/**
+ * @brief Sets size values that are not greater than threshold to zero
+ */
+void apply_threshold(float* values, std::size_t size, float threshold) noexcept;
+void apply_threshold(double* values, std::size_t size, double threshold) noexcept;
+template<typename T>
+inline void apply_threshold(T* values, std::size_t size, const T& threshold) noexcept {
+    for (std::size_t k = 0; k < size; ++k) {
+        if (values[k] <= threshold) {
+            values[k] = 0;
+        }
+    }
+}
+
+}  // namespace kernels
+}  // namespace mrio
+
+#endif
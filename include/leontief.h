@@ -0,0 +1,82 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_LEONTIEF_H
+#define LIBMRIO_LEONTIEF_H
+
+#include <vector>
+
+namespace settings {
+class SettingsNode;
+}
+
+namespace mrio {
+
+template<typename T, typename I>
+class Table;
+
+/**
+ * @brief Computes technical coefficients A, i.e. each flow divided by the total output of its receiving index
+ *
+ * @param table Table of flows
+ * @param final_demand Final demand per index, total output being the row total of table plus final demand
+ * @return Table of coefficients (same index set as table)
+ */
+template<typename T, typename I>
+Table<T, I> technical_coefficients(const Table<T, I>& table, const std::vector<T>& final_demand);
+
+/**
+ * @brief Computes Leontief inverse (I - A)^-1 by a blocked parallel LU decomposition
+ *        (without pivoting, as for non-negative and productive A all pivots of I - A are positive)
+ *
+ * Throws if a pivot is not above the square root of the machine epsilon, i.e. if I - A is (close to) singular
+ * or A is not productive.
+ *
+ * @param coefficients Table of technical coefficients A (non-negative)
+ * @return Leontief inverse (same index set as coefficients)
+ */
+template<typename T, typename I>
+Table<T, I> leontief_inverse(const Table<T, I>& coefficients);
+
+/**
+ * @brief Computes (I - A)^-1 * demand by the power series demand + A * demand + A^2 * demand + ...
+ *        on the non-zero coefficients only, without forming the inverse
+ *
+ * @param coefficients Table of technical coefficients A
+ * @param demand Demand per index
+ * @param tolerance Iteration stops when the last term is at most tolerance times the result (maximum norm)
+ * @param max_iterations Maximum number of terms before giving up
+ * @return Output per index needed to satisfy demand
+ */
+template<typename T, typename I>
+std::vector<T> leontief_solve(const Table<T, I>& coefficients, const std::vector<T>& demand, const T& tolerance, const I& max_iterations);
+
+/**
+ * @brief Replaces table by its Leontief inverse as given by the settings node (entries final_demand, optional solution,
+ *        tolerance and max_iterations)
+ *
+ * Final demand is read as rows of region, sector and value (missing indices have none). If solution is given, the output
+ * needed to satisfy the final demand is computed by leontief_solve and written there in the same format.
+ */
+template<typename T, typename I>
+Table<T, I> leontief(const Table<T, I>& table, const settings::SettingsNode& settings_node);
+
+}  // namespace mrio
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMRIO_MAPPING_H
+#define LIBMRIO_MAPPING_H
+
+#include <functional>
+#include <string>
+
+namespace settings {
+class SettingsNode;
+}
+
+namespace mrio {
+
+/**
+ * @brief Reads the mapping file given by the settings node (entries file, foreign_column, native_column)
+ *        and calls func for every row, skipping rows where either id is "-"
+ */
+void read_mapping_from_file(const settings::SettingsNode& mapping_node,
+                            const std::function<void(const std::string& foreign_id, const std::string& native_id)>& func);
+
+}  // namespace mrio
+
+#endif
@@ -5,7 +5,14 @@ endif()
 set(CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH} ${CMAKE_CURRENT_LIST_DIR}/cmake)
 
 add_library(libmrio STATIC
+  ${CMAKE_CURRENT_LIST_DIR}/src/affinity.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/aggregation.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/allocator.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/balancing.cpp
   ${CMAKE_CURRENT_LIST_DIR}/src/disaggregation.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/kernels.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/leontief.cpp
+  ${CMAKE_CURRENT_LIST_DIR}/src/mapping.cpp
   ${CMAKE_CURRENT_LIST_DIR}/src/MRIOIndexSet.cpp
   ${CMAKE_CURRENT_LIST_DIR}/src/MRIOTable.cpp
   ${CMAKE_CURRENT_LIST_DIR}/src/ProxyData.cpp)
@@ -31,6 +38,11 @@ if(LIBMRIO_WITH_NETCDF)
   target_compile_definitions(libmrio PUBLIC LIBMRIO_WITH_NETCDF)
 endif()
 
+option(LIBMRIO_SIMD_DISPATCH "Compile kernels for several instruction sets and select at runtime" ON)
+if(LIBMRIO_SIMD_DISPATCH)
+  target_compile_definitions(libmrio PRIVATE LIBMRIO_SIMD_DISPATCH)
+endif()
+
 option(LIBMRIO_VERBOSE "Verbose debug output" OFF)
 if(LIBMRIO_VERBOSE)
   target_compile_definitions(libmrio PUBLIC LIBMRIO_VERBOSE)
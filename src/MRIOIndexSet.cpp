@@ -20,8 +20,12 @@
 #include "MRIOIndexSet.h"
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 
 namespace mrio {
 
@@ -34,22 +38,30 @@ void IndexSet<I>::clear() {
     subsectors_.clear();
     subregions_.clear();
     indices_.clear();
+    index_sectors_.clear();
+    index_regions_.clear();
+    super_spans_offsets_.clear();
+    super_spans_.clear();
     size_ = 0;
     total_sectors_count_ = 0;
     total_regions_count_ = 0;
 }
 
 template<typename I>
-Sector<I>* IndexSet<I>::add_sector(const std::string& name) {
+Sector<I>* IndexSet<I>::add_sector(std::string_view name) {
     if (!subsectors_.empty()) {
         throw std::runtime_error("Cannot add new sector when already disaggregated");
     }
     const auto res = sectors_map.find(name);
     if (res == sectors_map.end()) {
         indices_.clear();
-        auto* s = new Sector<I>(name, supersectors_.size(), supersectors_.size());
+        index_sectors_.clear();
+        index_regions_.clear();
+        super_spans_offsets_.clear();
+        super_spans_.clear();
+        auto* s = new Sector<I>(std::string(name), supersectors_.size(), supersectors_.size());
         supersectors_.emplace_back(s);
-        sectors_map.emplace(name, s);
+        sectors_map.emplace(s->name, s);
         ++total_sectors_count_;
         return s;
     }
@@ -57,16 +69,20 @@ Sector<I>* IndexSet<I>::add_sector(const std::string& name) {
 }
 
 template<typename I>
-Region<I>* IndexSet<I>::add_region(const std::string& name) {
+Region<I>* IndexSet<I>::add_region(std::string_view name) {
     if (!subregions_.empty()) {
         throw std::runtime_error("Cannot add new region when already disaggregated");
     }
     const auto res = regions_map.find(name);
     if (res == regions_map.end()) {
         indices_.clear();
-        auto* r = new Region<I>(name, superregions_.size(), superregions_.size());
+        index_sectors_.clear();
+        index_regions_.clear();
+        super_spans_offsets_.clear();
+        super_spans_.clear();
+        auto* r = new Region<I>(std::string(name), superregions_.size(), superregions_.size());
         superregions_.emplace_back(r);
-        regions_map.emplace(name, r);
+        regions_map.emplace(r->name, r);
         ++total_regions_count_;
         return r;
     }
@@ -81,7 +97,7 @@ void IndexSet<I>::add_index(Sector<I>* sector_p, Region<I>* region_p) {
 }
 
 template<typename I>
-void IndexSet<I>::add_index(const std::string& sector_name, const std::string& region_name) {
+void IndexSet<I>::add_index(std::string_view sector_name, std::string_view region_name) {
     Sector<I>* sector_l = add_sector(sector_name);
     Region<I>* region_l = add_region(region_name);
     if (std::find(region_l->sectors_.begin(), region_l->sectors_.end(), sector_l) != region_l->sectors_.end()) {
@@ -91,39 +107,92 @@ void IndexSet<I>::add_index(const std::string& sector_name, const std::string& r
 }
 
 template<typename I>
-void IndexSet<I>::rebuild_indices() {
-    indices_.clear();
-    indices_.resize(total_sectors_count_ * total_regions_count_, NOT_GIVEN);
-    I index = 0;
-    for (const auto& r : superregions_) {
-        if (r->has_sub()) {
-            for (const auto& sub_r : r->sub()) {
-                for (const auto& s : r->sectors_) {
-                    if (s->has_sub()) {
-                        for (const auto& sub_s : s->sub()) {
-                            indices_[*sub_s * total_regions_count_ + *sub_r] = index;
-                            ++index;
-                        }
-                    } else {
-                        indices_[*s * total_regions_count_ + *sub_r] = index;
-                        ++index;
-                    }
-                }
+template<typename Func>
+void IndexSet<I>::for_each_index(Order order, Func func) const {
+    const auto for_each_sub = [](auto* part, const auto& f) {
+        if (part->has_sub()) {
+            for (const auto& sub : part->sub()) {
+                f(sub);
             }
         } else {
-            for (const auto& s : r->sectors_) {
-                if (s->has_sub()) {
-                    for (const auto& sub_s : s->sub()) {
-                        indices_[*sub_s * total_regions_count_ + *r] = index;
-                        ++index;
+            f(part);
+        }
+    };
+    switch (order) {
+        case Order::REGION_MAJOR:
+            for (const auto& r : superregions_) {
+                for_each_sub(r.get(), [&](Region<I>* sub_r) {
+                    for (const auto& s : r->sectors_) {
+                        for_each_sub(s, [&](Sector<I>* sub_s) { func(sub_s, sub_r); });
                     }
-                } else {
-                    indices_[*s * total_regions_count_ + *r] = index;
-                    ++index;
+                });
+            }
+            break;
+        case Order::SECTOR_MAJOR:
+            for (const auto& s : supersectors_) {
+                for_each_sub(s.get(), [&](Sector<I>* sub_s) {
+                    for (const auto& r : s->regions_) {
+                        for_each_sub(r, [&](Region<I>* sub_r) { func(sub_s, sub_r); });
+                    }
+                });
+            }
+            break;
+        case Order::CLUSTERED:
+            for (const auto& r : superregions_) {
+                for (const auto& s : r->sectors_) {
+                    for_each_sub(r.get(), [&](Region<I>* sub_r) {
+                        for_each_sub(s, [&](Sector<I>* sub_s) { func(sub_s, sub_r); });
+                    });
                 }
             }
+            break;
+    }
+}
+
+template<typename I>
+std::vector<I> IndexSet<I>::permutation(Order order) const {
+    std::vector<I> res;
+    res.reserve(size_);
+    for_each_index(order, [&](const Sector<I>* s, const Region<I>* r) { res.push_back((*this)(s, r)); });
+    return res;
+}
+
+template<typename I>
+void IndexSet<I>::rebuild_indices() {
+    // tables index their values by from * size + to
+    if (size_ > 0 && size_ > std::numeric_limits<I>::max() / size_) {
+        throw std::runtime_error("Too many indices for index type");
+    }
+    indices_.clear();
+    indices_.resize(total_sectors_count_ * total_regions_count_, NOT_GIVEN);
+    index_sectors_.resize(size_);
+    index_regions_.resize(size_);
+    I index = 0;
+    const auto add = [&](Sector<I>* s, Region<I>* r) {
+        indices_[*s * total_regions_count_ + *r] = index;
+        index_sectors_[index] = s;
+        index_regions_[index] = r;
+        ++index;
+    };
+    for_each_index(order_, add);
+    // depending on the order, a super (sector, region) combination can span several ranges
+    const I positions = supersectors_.size() * superregions_.size();
+    std::vector<std::vector<Span>> spans(positions);
+    for (I y = 0; y < size_; ++y) {
+        auto& position_spans = spans[index_sectors_[y]->super()->level_index() * superregions_.size() + index_regions_[y]->super()->level_index()];
+        if (!position_spans.empty() && position_spans.back().begin + position_spans.back().size == y) {
+            ++position_spans.back().size;
+        } else {
+            position_spans.push_back({y, 1});
         }
     }
+    super_spans_offsets_.resize(positions + 1);
+    super_spans_.clear();
+    for (I p = 0; p < positions; ++p) {
+        super_spans_offsets_[p] = super_spans_.size();
+        super_spans_.insert(std::end(super_spans_), std::begin(spans[p]), std::end(spans[p]));
+    }
+    super_spans_offsets_[positions] = super_spans_.size();
 }
 
 template<typename I>
@@ -131,8 +200,7 @@ IndexSet<I>::IndexSet(const IndexSet<I>& other)
     : size_(other.size_),
       total_regions_count_(other.total_regions_count_),
       total_sectors_count_(other.total_sectors_count_),
-      sectors_map(other.sectors_map),
-      regions_map(other.regions_map),
+      order_(other.order_),
       total_indices(*this),
       super_indices(*this) {
     copy_pointers(other);
@@ -143,56 +211,81 @@ IndexSet<I>& IndexSet<I>::operator=(const IndexSet<I>& other) {
     size_ = other.size_;
     total_regions_count_ = other.total_regions_count_;
     total_sectors_count_ = other.total_sectors_count_;
-    sectors_map = other.sectors_map;
-    regions_map = other.regions_map;
+    order_ = other.order_;
+    sectors_map.clear();
+    regions_map.clear();
     supersectors_.clear();
     superregions_.clear();
     subsectors_.clear();
     subregions_.clear();
+    index_sectors_.clear();
+    index_regions_.clear();
+    super_spans_offsets_.clear();
+    super_spans_.clear();
     copy_pointers(other);
     return *this;
 }
 
 template<typename I>
 void IndexSet<I>::copy_pointers(const IndexSet<I>& other) {
-    for (I it = 0; it < other.subsectors_.size(); ++it) {
-        auto* n = new Sector<I>(*other.subsectors_[it]);
+    // sectors and regions are stored at their level index, so all cross links can be resolved by position
+    const auto sector_at = [this](const Sector<I>* s) { return s->is_sub() ? subsectors_[s->level_index_].get() : supersectors_[s->level_index_].get(); };
+    const auto region_at = [this](const Region<I>* r) { return r->is_sub() ? subregions_[r->level_index_].get() : superregions_[r->level_index_].get(); };
+    sectors_map.reserve(other.sectors_map.size());
+    regions_map.reserve(other.regions_map.size());
+    subsectors_.reserve(other.subsectors_.size());
+    for (const auto& s : other.subsectors_) {
+        auto* n = new Sector<I>(*s);
         subsectors_.emplace_back(n);
-        sectors_map.at(n->name) = n;
+        sectors_map.emplace(n->name, n);
     }
-    for (I it = 0; it < other.subregions_.size(); ++it) {
-        auto* n = new Region<I>(*other.subregions_[it]);
+    subregions_.reserve(other.subregions_.size());
+    for (const auto& r : other.subregions_) {
+        auto* n = new Region<I>(*r);
         subregions_.emplace_back(n);
-        regions_map.at(n->name) = n;
+        regions_map.emplace(n->name, n);
     }
-    for (I it = 0; it < other.supersectors_.size(); ++it) {
-        auto* n = new Sector<I>(*other.supersectors_[it]);
+    supersectors_.reserve(other.supersectors_.size());
+    for (const auto& s : other.supersectors_) {
+        auto* n = new Sector<I>(*s);
         supersectors_.emplace_back(n);
-        sectors_map.at(n->name) = n;
-        for (I it2 = 0; it2 < n->sub_.size(); ++it2) {
-            n->sub_[it2] = sectors_map.at(n->sub_[it2]->name);
-            n->sub_[it2]->parent_ = n;
-        }
+        sectors_map.emplace(n->name, n);
     }
-    for (I it = 0; it < other.superregions_.size(); ++it) {
-        auto* n = new Region<I>(*other.superregions_[it]);
+    superregions_.reserve(other.superregions_.size());
+    for (const auto& r : other.superregions_) {
+        auto* n = new Region<I>(*r);
         superregions_.emplace_back(n);
-        regions_map.at(n->name) = n;
-        for (I it2 = 0; it2 < n->sub_.size(); ++it2) {
-            n->sub_[it2] = regions_map.at(n->sub_[it2]->name);
-            n->sub_[it2]->parent_ = n;
+        regions_map.emplace(n->name, n);
+    }
+    for (const auto& n : supersectors_) {
+        for (auto& sub : n->sub_) {
+            sub = sector_at(sub);
+            sub->parent_ = n.get();
         }
-        for (I it2 = 0; it2 < n->sectors_.size(); ++it2) {
-            n->sectors_[it2] = sectors_map.at(n->sectors_[it2]->name);
+        for (auto& region_l : n->regions_) {
+            region_l = region_at(region_l);
         }
     }
-    for (I it = 0; it < other.supersectors_.size(); ++it) {
-        Sector<I>* n = supersectors_[it].get();
-        for (I it2 = 0; it2 < n->regions_.size(); ++it2) {
-            n->regions_[it2] = regions_map.at(n->regions_[it2]->name);
+    for (const auto& n : superregions_) {
+        for (auto& sub : n->sub_) {
+            sub = region_at(sub);
+            sub->parent_ = n.get();
+        }
+        for (auto& sector_l : n->sectors_) {
+            sector_l = sector_at(sector_l);
         }
     }
-    rebuild_indices();
+    indices_ = other.indices_;
+    super_spans_offsets_ = other.super_spans_offsets_;
+    super_spans_ = other.super_spans_;
+    index_sectors_.reserve(other.index_sectors_.size());
+    for (const auto& s : other.index_sectors_) {
+        index_sectors_.push_back(sector_at(s));
+    }
+    index_regions_.reserve(other.index_regions_.size());
+    for (const auto& r : other.index_regions_) {
+        index_regions_.push_back(region_at(r));
+    }
 }
 
 template<typename I>
@@ -201,12 +294,15 @@ void IndexSet<I>::insert_subsectors(const std::string& name, const std::vector<s
     if (!super) {
         throw std::runtime_error("Sector '" + name + "' is not a super sector");
     }
+    if (super->has_sub()) {
+        throw std::runtime_error("Sector '" + name + "' already has subsectors");
+    }
     I total_index = super->total_index_;
     I level_index = subsectors_.size();
     I subindex = 0;
     for (const auto& sub_name : newsubsectors) {
         auto* sub = new Sector<I>(sub_name, total_index, level_index, super, subindex);
-        sectors_map.emplace(sub_name, sub);
+        sectors_map.emplace(sub->name, sub);
         subsectors_.emplace_back(sub);
         super->sub_.push_back(sub);
         ++total_index;
@@ -240,12 +336,15 @@ void IndexSet<I>::insert_subregions(const std::string& name, const std::vector<s
     if (!super) {
         throw std::runtime_error("Region '" + name + "' is not a super region");
     }
+    if (super->has_sub()) {
+        throw std::runtime_error("Region '" + name + "' already has subregions");
+    }
     I total_index = super->total_index_;
     I level_index = subregions_.size();
     I subindex = 0;
     for (const auto& sub_name : newsubregions) {
         auto* sub = new Region<I>(sub_name, total_index, level_index, super, subindex);
-        regions_map.emplace(sub_name, sub);
+        regions_map.emplace(sub->name, sub);
         subregions_.emplace_back(sub);
         super->sub_.push_back(sub);
         ++total_index;
@@ -273,6 +372,107 @@ void IndexSet<I>::insert_subregions(const std::string& name, const std::vector<s
     rebuild_indices();
 }
 
+template<typename I>
+std::pair<I, I> IndexSet<I>::range(const Sector<I>* sector_p, const Region<I>* region_p) const {
+    if (region_p == nullptr) {
+        if (sector_p != nullptr) {
+            throw std::runtime_error("Sector '" + sector_p->name + "' is not contiguous over all regions");
+        }
+        return {0, size_};
+    }
+    I first = size_;
+    I last = 0;
+    I count = 0;
+    const auto add = [&](const Sector<I>* s, const Region<I>* r) {
+        const I& index = (*this)(s, r);
+        if (index != NOT_GIVEN) {
+            first = std::min(first, index);
+            last = std::max(last, index);
+            ++count;
+        }
+    };
+    const auto add_for_region = [&](const Region<I>* r) {
+        if (sector_p == nullptr) {
+            for (const auto& s : r->super()->sectors()) {
+                if (s->has_sub()) {
+                    for (const auto& sub_s : s->sub()) {
+                        add(sub_s, r);
+                    }
+                } else {
+                    add(s, r);
+                }
+            }
+        } else if (sector_p->has_sub()) {
+            for (const auto& sub_s : sector_p->sub()) {
+                add(sub_s, r);
+            }
+        } else {
+            add(sector_p, r);
+        }
+    };
+    if (region_p->has_sub()) {
+        for (const auto& sub_r : region_p->sub()) {
+            add_for_region(sub_r);
+        }
+    } else {
+        add_for_region(region_p);
+    }
+    if (count == 0) {
+        return {0, 0};
+    }
+    if (last - first + 1 != count) {
+        throw std::runtime_error("Indices of " + (sector_p == nullptr ? std::string("") : sector_p->name) + ":" + region_p->name + " are not contiguous");
+    }
+    return {first, count};
+}
+
+template<typename I>
+std::vector<typename IndexSet<I>::Span> IndexSet<I>::spans(const Sector<I>* sector_p, const Region<I>* region_p) const {
+    if (sector_p == nullptr && region_p == nullptr) {
+        return {{0, size_}};
+    }
+    std::vector<Span> spans;
+    // super arguments cover whole super spans, sub arguments only some of their indices
+    const bool whole_spans = (sector_p == nullptr || !sector_p->is_sub()) && (region_p == nullptr || !region_p->is_sub());
+    const auto add_position = [&](const Sector<I>* s, const Region<I>* r) {
+        for (const auto& span : super_spans(s, r)) {
+            if (whole_spans) {
+                spans.push_back(span);
+            } else {
+                for (I y = span.begin; y < span.begin + span.size; ++y) {
+                    if ((sector_p == nullptr || sector_p == index_sectors_[y] || sector_p == index_sectors_[y]->parent())
+                        && (region_p == nullptr || region_p == index_regions_[y] || region_p == index_regions_[y]->parent())) {
+                        spans.push_back({y, 1});
+                    }
+                }
+            }
+        }
+    };
+    if (sector_p == nullptr) {
+        for (const auto& s : supersectors_) {
+            add_position(s.get(), region_p->super());
+        }
+    } else if (region_p == nullptr) {
+        for (const auto& r : superregions_) {
+            add_position(sector_p->super(), r.get());
+        }
+    } else {
+        add_position(sector_p->super(), region_p->super());
+    }
+    std::sort(std::begin(spans), std::end(spans), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+    std::vector<Span> res;
+    for (const auto& span : spans) {
+        if (!res.empty() && res.back().begin + res.back().size == span.begin) {
+            res.back().size += span.size;
+        } else {
+            res.push_back(span);
+        }
+    }
+    return res;
+}
+
 template class IndexSet<std::size_t>;
+template class IndexSet<std::uint32_t>;
 template<> const std::size_t IndexSet<std::size_t>::NOT_GIVEN = static_cast<std::size_t>(-1);
+template<> const std::uint32_t IndexSet<std::uint32_t>::NOT_GIVEN = static_cast<std::uint32_t>(-1);
 }  // namespace mrio
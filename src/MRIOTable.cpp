@@ -18,12 +18,16 @@
 */
 
 #include "MRIOTable.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <stdexcept>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 #ifdef LIBMRIO_WITH_NETCDF
 #include <ncDim.h>
 #include <ncFile.h>
@@ -49,27 +53,254 @@ namespace mrio {
 #endif
 
 template<typename T, typename I>
-T Table<T, I>::sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
-    T res = 0;
+typename Table<T, I>::accumulator_type Table<T, I>::sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
+    if (has_aggregate_index() && (i == nullptr || !i->is_sub()) && (r == nullptr || !r->is_sub()) && (j == nullptr || !j->is_sub())
+        && (s == nullptr || !s->is_sub())) {
+        return aggregated_sum(i, r, j, s);
+    }
+    if (has_sum_plans()) {
+        return planned_sum(sum_plans[sum_plan_key(i, r)], sum_plans[sum_plan_key(j, s)]);
+    }
+    accumulator_type res = 0;
     build_sum_source<false>(res, i, r, j, s);
     return res;
 }
 
 template<typename T, typename I>
-T Table<T, I>::basesum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
-    T res = 0;
+typename Table<T, I>::accumulator_type Table<T, I>::planned_sum(const std::vector<typename IndexSet<I>::Span>& rows,
+                                                                const std::vector<typename IndexSet<I>::Span>& cols) const noexcept {
+    accumulator_type res = 0;
+    for (const auto& row_span : rows) {
+        for (I y = row_span.begin; y < row_span.begin + row_span.size; ++y) {
+            const T* row = &data[y * index_set_->size()];
+            for (const auto& col_span : cols) {
+                res += pairwise_sum<accumulator_type>(row + col_span.begin, col_span.size);
+            }
+        }
+    }
+    return res;
+}
+
+template<typename T, typename I>
+void Table<T, I>::build_sum_plans() {
+    const I sectors_count = 1 + index_set_->supersectors().size() + index_set_->subsectors().size();
+    const I regions_count = 1 + index_set_->superregions().size() + index_set_->subregions().size();
+    std::vector<const Sector<I>*> sectors(sectors_count, nullptr);
+    std::vector<const Region<I>*> regions(regions_count, nullptr);
+    for (const auto& i : index_set_->supersectors()) {
+        sectors[sum_plan_key(i.get(), nullptr) / regions_count] = i.get();
+    }
+    for (const auto& i : index_set_->subsectors()) {
+        sectors[sum_plan_key(i.get(), nullptr) / regions_count] = i.get();
+    }
+    for (const auto& r : index_set_->superregions()) {
+        regions[sum_plan_key(nullptr, r.get())] = r.get();
+    }
+    for (const auto& r : index_set_->subregions()) {
+        regions[sum_plan_key(nullptr, r.get())] = r.get();
+    }
+    sum_plans.clear();
+    sum_plans.resize(sectors_count * regions_count);
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t k = 0; k < sum_plans.size(); ++k) {
+        sum_plans[k] = index_set_->spans(sectors[k / regions_count], regions[k % regions_count]);
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::clear_sum_plans() {
+    sum_plans.clear();
+}
+
+template<typename T, typename I>
+typename Table<T, I>::accumulator_type Table<T, I>::aggregated_sum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
+    const auto for_all_super_positions = [&](const Sector<I>* sector, const Region<I>* region, auto func) {
+        if (sector == nullptr) {
+            for (const auto& k : index_set_->supersectors()) {
+                if (region == nullptr) {
+                    for (const auto& l : index_set_->superregions()) {
+                        func(super_position(k.get(), l.get()));
+                    }
+                } else {
+                    func(super_position(k.get(), region));
+                }
+            }
+        } else if (region == nullptr) {
+            for (const auto& l : index_set_->superregions()) {
+                func(super_position(sector, l.get()));
+            }
+        } else {
+            func(super_position(sector, region));
+        }
+    };
+    accumulator_type res = 0;
+    if (j == nullptr && s == nullptr) {
+        for_all_super_positions(i, r, [&](I p) { res += aggregate_rows[p]; });
+    } else if (i == nullptr && r == nullptr) {
+        for_all_super_positions(j, s, [&](I q) { res += aggregate_cols[q]; });
+    } else {
+        const I m = aggregate_rows.size();
+        for_all_super_positions(i, r, [&](I p) { for_all_super_positions(j, s, [&](I q) { res += aggregate_blocks[p * m + q]; }); });
+    }
+    return res;
+}
+
+template<typename T, typename I>
+void Table<T, I>::build_aggregate_index() {
+    const I m = index_set_->supersectors().size() * index_set_->superregions().size();
+    const I n = index_set_->size();
+    std::vector<I> positions(n);
+    std::vector<std::vector<I>> rows_at(m);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        positions[y] = super_position(index_set_->sector_of(y)->super(), index_set_->region_of(y)->super());
+    }
+    for (I y = 0; y < n; ++y) {
+        rows_at[positions[y]].push_back(y);
+    }
+    aggregate_blocks.assign(m * m, 0);
+    aggregate_rows.assign(m, 0);
+    aggregate_cols.assign(m, 0);
+    // each block row is only written by the thread handling its super position
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t p = 0; p < m; ++p) {
+        accumulator_type* block_row = &aggregate_blocks[p * m];
+        for (const auto& y : rows_at[p]) {
+            const T* row = &data[y * n];
+            for (I x = 0; x < n; ++x) {
+                block_row[positions[x]] += row[x];
+            }
+        }
+        for (I q = 0; q < m; ++q) {
+            aggregate_rows[p] += block_row[q];
+        }
+    }
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t q = 0; q < m; ++q) {
+        for (I p = 0; p < m; ++p) {
+            aggregate_cols[q] += aggregate_blocks[p * m + q];
+        }
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::update_aggregate_index(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) noexcept {
+    accumulator_type res = 0;
+    add_leaf_sum(res, i, r, j, s);
+    const I p = super_position(i, r);
+    const I q = super_position(j, s);
+    const accumulator_type delta = res - aggregate_blocks[p * aggregate_rows.size() + q];
+    aggregate_blocks[p * aggregate_rows.size() + q] = res;
+#pragma omp atomic
+    aggregate_rows[p] += delta;
+#pragma omp atomic
+    aggregate_cols[q] += delta;
+}
+
+template<typename T, typename I>
+void Table<T, I>::clear_aggregate_index() {
+    aggregate_blocks.clear();
+    aggregate_rows.clear();
+    aggregate_cols.clear();
+}
+
+template<typename T, typename I>
+void Table<T, I>::build_marginals() {
+    const I n = index_set_->size();
+    row_totals_.assign(n, 0);
+    col_totals_.assign(n, 0);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        row_totals_[y] = pairwise_sum<accumulator_type>(&data[y * n], n);
+    }
+    // columns are split among threads so that each thread only writes its own totals
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t x = 0; x < n; ++x) {
+        accumulator_type res = 0;
+        for (I y = 0; y < n; ++y) {
+            res += data[y * n + x];
+        }
+        col_totals_[x] = res;
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::clear_marginals() {
+    row_totals_.clear();
+    col_totals_.clear();
+}
+
+template<typename T, typename I>
+void Table<T, I>::add_block_to_marginals(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s, const T& factor) {
+    const I n = index_set_->size();
+    const auto rows = index_set_->super_spans(i, r);
+    const auto cols = index_set_->super_spans(j, s);
+    for (const auto& row : rows) {
+        for (I y = row.begin; y < row.begin + row.size; ++y) {
+            accumulator_type row_sum = 0;
+            for (const auto& col : cols) {
+                row_sum += pairwise_sum<accumulator_type>(&data[y * n + col.begin], col.size);
+            }
+#pragma omp atomic
+            row_totals_[y] += factor * row_sum;
+        }
+    }
+    for (const auto& col : cols) {
+        for (I x = col.begin; x < col.begin + col.size; ++x) {
+            accumulator_type col_sum = 0;
+            for (const auto& row : rows) {
+                for (I y = row.begin; y < row.begin + row.size; ++y) {
+                    col_sum += data[y * n + x];
+                }
+            }
+#pragma omp atomic
+            col_totals_[x] += factor * col_sum;
+        }
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::add_leaf_sum(accumulator_type& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
+    if (i->has_sub()) {
+        for (const auto k : i->sub()) {
+            add_leaf_sum(res, k, r, j, s);
+        }
+    } else if (r->has_sub()) {
+        for (const auto k : r->sub()) {
+            add_leaf_sum(res, i, k, j, s);
+        }
+    } else if (j->has_sub()) {
+        for (const auto k : j->sub()) {
+            add_leaf_sum(res, i, r, k, s);
+        }
+    } else if (s->has_sub()) {
+        for (const auto k : s->sub()) {
+            add_leaf_sum(res, i, r, j, k);
+        }
+    } else {
+        const I& from = (*index_set_)(i, r);
+        const I& to = (*index_set_)(j, s);
+        if (from != IndexSet<I>::NOT_GIVEN && to != IndexSet<I>::NOT_GIVEN) {
+            res += (*this)(from, to);
+        }
+    }
+}
+
+template<typename T, typename I>
+typename Table<T, I>::accumulator_type Table<T, I>::basesum(const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
+    accumulator_type res = 0;
     build_sum_source<true>(res, i, r, j, s);
     return res;
 }
 
 template<typename T, typename I>
 template<bool use_base>
-void Table<T, I>::build_sum_source(T& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
+void Table<T, I>::build_sum_source(accumulator_type& res, const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) const noexcept {
     if (unlikely(i == nullptr)) {
         if (unlikely(r == nullptr)) {
-            build_sum_target<use_base>(res, index_set_.supersectors(), true, j, s);
+            build_sum_target<use_base>(res, index_set_->supersectors(), true, j, s);
         } else {
-            build_sum_target<use_base>(res, index_set_.supersectors(), r, j, s);
+            build_sum_target<use_base>(res, index_set_->supersectors(), r, j, s);
         }
     } else if (unlikely(i->has_sub())) {
         if (unlikely(r == nullptr)) {
@@ -92,12 +323,12 @@ void Table<T, I>::build_sum_source(T& res, const Sector<I>* i, const Region<I>*
 
 template<typename T, typename I>
 template<bool use_base, typename Arg_i, typename Arg_r>
-void Table<T, I>::build_sum_target(T& res, Arg_i&& i, Arg_r&& r, const Sector<I>* j, const Region<I>* s) const noexcept {
+void Table<T, I>::build_sum_target(accumulator_type& res, Arg_i&& i, Arg_r&& r, const Sector<I>* j, const Region<I>* s) const noexcept {
     if (unlikely(j == nullptr)) {
         if (unlikely(s == nullptr)) {
-            add_sum<use_base, 0>(res, std::forward<Arg_i>(i), std::forward<Arg_r>(r), index_set_.supersectors(), true);
+            add_sum<use_base, 0>(res, std::forward<Arg_i>(i), std::forward<Arg_r>(r), index_set_->supersectors(), true);
         } else {
-            add_sum<use_base, 0>(res, std::forward<Arg_i>(i), std::forward<Arg_r>(r), index_set_.supersectors(), s);
+            add_sum<use_base, 0>(res, std::forward<Arg_i>(i), std::forward<Arg_r>(r), index_set_->supersectors(), s);
         }
     } else if (unlikely(j->has_sub())) {
         if (unlikely(s == nullptr)) {
@@ -120,7 +351,7 @@ void Table<T, I>::build_sum_target(T& res, Arg_i&& i, Arg_r&& r, const Sector<I>
 
 template<typename T, typename I>
 template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-void Table<T, I>::add_sum(T& res, const std::vector<Arg1*>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
+void Table<T, I>::add_sum(accumulator_type& res, const std::vector<Arg1*>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
     static_assert(c < 4);
     for (const auto k : arg1) {
         add_sum<use_base, c + 1>(res, std::forward<Arg2>(arg2), std::forward<Arg3>(arg3), std::forward<Arg4>(arg4), k);
@@ -129,7 +360,7 @@ void Table<T, I>::add_sum(T& res, const std::vector<Arg1*>& arg1, Arg2&& arg2, A
 
 template<typename T, typename I>
 template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-void Table<T, I>::add_sum(T& res, const std::vector<std::unique_ptr<Arg1>>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
+void Table<T, I>::add_sum(accumulator_type& res, const std::vector<std::unique_ptr<Arg1>>& arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
     static_assert(c < 4);
     for (const auto& k : arg1) {
         add_sum<use_base, c + 1>(res, std::forward<Arg2>(arg2), std::forward<Arg3>(arg3), std::forward<Arg4>(arg4), k.get());
@@ -138,7 +369,7 @@ void Table<T, I>::add_sum(T& res, const std::vector<std::unique_ptr<Arg1>>& arg1
 
 template<typename T, typename I>
 template<bool use_base, int c, typename Arg3, typename Arg4>
-void Table<T, I>::add_sum(T& res, const std::vector<std::unique_ptr<Sector<I>>>& arg1, bool, Arg3&& arg3, Arg4&& arg4) const noexcept {
+void Table<T, I>::add_sum(accumulator_type& res, const std::vector<std::unique_ptr<Sector<I>>>& arg1, bool, Arg3&& arg3, Arg4&& arg4) const noexcept {
     static_assert(c < 4);
     for (const auto& sec : arg1) {
         for (const auto& reg : sec->super()->regions()) {
@@ -149,27 +380,79 @@ void Table<T, I>::add_sum(T& res, const std::vector<std::unique_ptr<Sector<I>>>&
 
 template<typename T, typename I>
 template<bool use_base, int c, typename Arg1, typename Arg2, typename Arg3, typename Arg4>
-void Table<T, I>::add_sum(T& res, const Arg1* arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
+void Table<T, I>::add_sum(accumulator_type& res, const Arg1* arg1, Arg2&& arg2, Arg3&& arg3, Arg4&& arg4) const noexcept {
     if constexpr (c < 4) {
         add_sum<use_base, c + 1>(res, std::forward<Arg2>(arg2), std::forward<Arg3>(arg3), std::forward<Arg4>(arg4), arg1);
     } else {
         if constexpr (use_base) {
             res += base(arg1, arg2, arg3, arg4);
         } else {
-            res += (*this)(arg1, arg2, arg3, arg4);
+            // arguments expanded from nullptr are super sectors/regions, which might have subs or not exist in combination
+            add_leaf_sum(res, arg1, arg2, arg3, arg4);
+        }
+    }
+}
+
+template<typename T, typename I>
+Table<T, I> Table<T, I>::aggregate(const std::unordered_map<std::string, std::string>& sector_map,
+                                   const std::unordered_map<std::string, std::string>& region_map) const {
+    const auto mapped = [](const std::unordered_map<std::string, std::string>& map, const std::string& name) -> const std::string& {
+        const auto it = map.find(name);
+        return it == std::end(map) ? name : it->second;
+    };
+    Table<T, I> res;
+    auto res_index_set = std::make_shared<IndexSet<I>>();
+    std::vector<std::pair<Sector<I>*, Region<I>*>> new_indices(index_set_->size());
+    for (const auto& index : index_set_->total_indices) {
+        Sector<I>* sector = res_index_set->add_sector(mapped(sector_map, index.sector->name));
+        Region<I>* region = res_index_set->add_region(mapped(region_map, index.region->name));
+        if (std::find(std::begin(region->sectors()), std::end(region->sectors()), sector) == std::end(region->sectors())) {
+            res_index_set->add_index(sector, region);
+        }
+        new_indices[index.index] = {sector, region};
+    }
+    res_index_set->rebuild_indices();
+    res.index_set_ = res_index_set;
+
+    const I n = index_set_->size();
+    const I new_n = res_index_set->size();
+    std::vector<I> targets(n);
+    std::vector<std::vector<I>> rows_at(new_n);
+    for (I y = 0; y < n; ++y) {
+        targets[y] = (*res_index_set)(new_indices[y].first, new_indices[y].second);
+        rows_at[targets[y]].push_back(y);
+    }
+    resize_zeroed(res.data, new_n * new_n);
+    // each row of the new table is only written by the thread handling it, every row of this table is read once
+#pragma omp parallel default(shared)
+    {
+        std::vector<accumulator_type> row(new_n);
+#pragma omp for schedule(dynamic)
+        for (std::size_t t = 0; t < new_n; ++t) {
+            std::fill(std::begin(row), std::end(row), 0);
+            for (const auto& y : rows_at[t]) {
+                const T* from = &data[y * n];
+                for (I x = 0; x < n; ++x) {
+                    row[targets[x]] += from[x];
+                }
+            }
+            std::copy(std::begin(row), std::end(row), &res.data[t * new_n]);
         }
     }
+    return res;
 }
 
 template<typename T, typename I>
 void Table<T, I>::read_indices_from_csv(std::istream& indicesstream) {
     try {
+        auto index_set = std::make_shared<IndexSet<I>>(*index_set_);
         csv::Parser parser(indicesstream);
         do {
             const std::tuple<std::string, std::string> c = parser.read<std::string, std::string>();
-            index_set_.add_index(std::get<1>(c), std::get<0>(c));
+            index_set->add_index(std::get<1>(c), std::get<0>(c));
         } while (parser.next_row());
-        index_set_.rebuild_indices();
+        index_set->rebuild_indices();
+        index_set_ = std::move(index_set);
     } catch (const csv::parser_exception& ex) {
         throw std::runtime_error(ex.format());
     }
@@ -181,11 +464,11 @@ void Table<T, I>::read_data_from_csv(std::istream& datastream, const T& threshol
     try {
         csv::Parser parser(datastream);
         auto d = data.begin();
-        for (l = 0; l < index_set_.size(); l++) {
+        for (l = 0; l < index_set_->size(); l++) {
             if (l == std::numeric_limits<I>::max()) {
                 throw std::runtime_error("Too many rows");
             }
-            for (I c = 0; c < index_set_.size(); c++) {
+            for (I c = 0; c < index_set_->size(); c++) {
                 if (c == std::numeric_limits<I>::max()) {
                     throw std::runtime_error("Too many columns");
                 }
@@ -206,20 +489,27 @@ void Table<T, I>::read_data_from_csv(std::istream& datastream, const T& threshol
 template<typename T, typename I>
 void Table<T, I>::read_from_csv(std::istream& indicesstream, std::istream& datastream, const T& threshold) {
     read_indices_from_csv(indicesstream);
-    data.resize(index_set_.size() * index_set_.size(), 0);
+    resize_zeroed(data, index_set_->size() * index_set_->size());
     read_data_from_csv(datastream, threshold);
 }
 
 template<typename T, typename I>
-void Table<T, I>::write_to_csv(std::ostream& indicesstream, std::ostream& datastream) const {
+void Table<T, I>::write_to_csv(std::ostream& indicesstream, std::ostream& datastream, bool region_major) const {
     debug_out();
-    for (const auto& row : index_set_.total_indices) {
-        for (const auto& col : index_set_.total_indices) {
-            datastream << at(row.index, col.index) << ",";
+    std::vector<I> order;
+    if (region_major) {
+        order = index_set_->permutation(IndexSet<I>::Order::REGION_MAJOR);
+    } else {
+        order.resize(index_set_->size());
+        std::iota(std::begin(order), std::end(order), 0);
+    }
+    for (const auto& row : order) {
+        for (const auto& col : order) {
+            datastream << at(row, col) << ",";
         }
         datastream.seekp(-1, std::ios_base::end);
         datastream << '\n';
-        indicesstream << row.sector->name << "," << row.region->name << '\n';
+        indicesstream << index_set_->sector_of(row)->name << "," << index_set_->region_of(row)->name << '\n';
     }
     datastream << std::flush;
     indicesstream << std::flush;
@@ -229,6 +519,7 @@ void Table<T, I>::write_to_csv(std::ostream& indicesstream, std::ostream& datast
 template<typename T, typename I>
 void Table<T, I>::read_from_netcdf(const std::string& filename, const T& threshold) {
     netCDF::NcFile file(filename, netCDF::NcFile::read);
+    auto index_set = std::make_shared<IndexSet<I>>(*index_set_);
 
     std::size_t sectors_count = file.getDim("sector").getSize();
     {
@@ -236,7 +527,7 @@ void Table<T, I>::read_from_netcdf(const std::string& filename, const T& thresho
         std::vector<const char*> sectors_val(sectors_count);
         sectors_var.getVar(&sectors_val[0]);
         for (const auto& sector : sectors_val) {
-            index_set_.add_sector(sector);
+            index_set->add_sector(sector);
         }
     }
 
@@ -246,22 +537,22 @@ void Table<T, I>::read_from_netcdf(const std::string& filename, const T& thresho
         std::vector<const char*> regions_val(regions_count);
         regions_var.getVar(&regions_val[0]);
         for (const auto& region : regions_val) {
-            index_set_.add_region(region);
+            index_set->add_region(region);
         }
     }
 
     netCDF::NcDim index_dim = file.getDim("index");
     if (index_dim.isNull()) {
-        data.resize(regions_count * sectors_count * regions_count * sectors_count);
+        resize_zeroed(data, regions_count * sectors_count * regions_count * sectors_count);
         if (file.getVar("flows").getDims()[0].getName() == "sector") {
             std::vector<T> data_l(regions_count * sectors_count * regions_count * sectors_count);
             file.getVar("flows").getVar(&data_l[0]);
             auto d = data.begin();
-            for (const auto& region_from : index_set_.superregions()) {
-                for (const auto& sector_from : index_set_.supersectors()) {
-                    index_set_.add_index(sector_from.get(), region_from.get());
-                    for (const auto& region_to : index_set_.superregions()) {
-                        for (const auto& sector_to : index_set_.supersectors()) {
+            for (const auto& region_from : index_set->superregions()) {
+                for (const auto& sector_from : index_set->supersectors()) {
+                    index_set->add_index(sector_from.get(), region_from.get());
+                    for (const auto& region_to : index_set->superregions()) {
+                        for (const auto& sector_to : index_set->supersectors()) {
                             const T& d_l = data_l[((*sector_from * regions_count + *region_from) * sectors_count + *sector_to) * regions_count + *region_to];
                             if (d_l > threshold) {
                                 *d = d_l;
@@ -274,17 +565,13 @@ void Table<T, I>::read_from_netcdf(const std::string& filename, const T& thresho
                 }
             }
         } else {
-            for (const auto& sector : index_set_.supersectors()) {
-                for (const auto& region : index_set_.superregions()) {
-                    index_set_.add_index(sector.get(), region.get());
+            for (const auto& sector : index_set->supersectors()) {
+                for (const auto& region : index_set->superregions()) {
+                    index_set->add_index(sector.get(), region.get());
                 }
             }
             file.getVar("flows").getVar(&data[0]);
-            for (auto& d : data) {
-                if (d <= threshold) {
-                    d = 0;
-                }
-            }
+            kernels::apply_threshold(&data[0], data.size(), threshold);
         }
     } else {
         std::size_t index_size = index_dim.getSize();
@@ -295,17 +582,14 @@ void Table<T, I>::read_from_netcdf(const std::string& filename, const T& thresho
         std::vector<std::uint32_t> index_region_val(index_size);
         index_region_var.getVar(&index_region_val[0]);
         for (unsigned int i = 0; i < index_size; ++i) {
-            index_set_.add_index(index_set_.supersectors()[index_sector_val[i]].get(), index_set_.superregions()[index_region_val[i]].get());
+            index_set->add_index(index_set->supersectors()[index_sector_val[i]].get(), index_set->superregions()[index_region_val[i]].get());
         }
-        data.resize(index_size * index_size);
+        resize_zeroed(data, index_size * index_size);
         file.getVar("flows").getVar(&data[0]);
-        for (auto& d : data) {
-            if (d <= threshold) {
-                d = 0;
-            }
-        }
+        kernels::apply_threshold(&data[0], data.size(), threshold);
     }
-    index_set_.rebuild_indices();
+    index_set->rebuild_indices();
+    index_set_ = std::move(index_set);
 }
 #endif
 
@@ -315,11 +599,11 @@ void Table<T, I>::write_to_netcdf(const std::string& filename) const {
     debug_out();
     netCDF::NcFile file(filename, netCDF::NcFile::replace, netCDF::NcFile::nc4);
 
-    netCDF::NcDim sectors_dim = file.addDim("sector", index_set_.total_sectors_count());
+    netCDF::NcDim sectors_dim = file.addDim("sector", index_set_->total_sectors_count());
     {
         netCDF::NcVar sectors_var = file.addVar("sector", netCDF::NcType::nc_STRING, {sectors_dim});
         I i = 0;
-        for (const auto& sector : index_set_.supersectors()) {
+        for (const auto& sector : index_set_->supersectors()) {
             if (sector->has_sub()) {
                 for (const auto& subsector : sector->sub()) {
                     sectors_var.putVar({i}, subsector->name);
@@ -332,11 +616,11 @@ void Table<T, I>::write_to_netcdf(const std::string& filename) const {
         }
     }
 
-    netCDF::NcDim regions_dim = file.addDim("region", index_set_.total_regions_count());
+    netCDF::NcDim regions_dim = file.addDim("region", index_set_->total_regions_count());
     {
         netCDF::NcVar regions_var = file.addVar("region", netCDF::NcType::nc_STRING, {regions_dim});
         I i = 0;
-        for (const auto& region : index_set_.superregions()) {
+        for (const auto& region : index_set_->superregions()) {
             if (region->has_sub()) {
                 for (const auto& subregion : region->sub()) {
                     regions_var.putVar({i}, subregion->name);
@@ -349,19 +633,31 @@ void Table<T, I>::write_to_netcdf(const std::string& filename) const {
         }
     }
 
-    netCDF::NcDim index_dim = file.addDim("index", index_set_.size());
+    // files are always written region-major
+    const auto order = index_set_->permutation(IndexSet<I>::Order::REGION_MAJOR);
+    netCDF::NcDim index_dim = file.addDim("index", index_set_->size());
     {
         netCDF::NcVar index_sector_var = file.addVar("index_sector", netCDF::NcType::nc_UINT, {index_dim});
         netCDF::NcVar index_region_var = file.addVar("index_region", netCDF::NcType::nc_UINT, {index_dim});
-        for (const auto& index : index_set_.total_indices) {
-            index_sector_var.putVar({index.index}, static_cast<unsigned int>(index.sector->total_index()));
-            index_region_var.putVar({index.index}, static_cast<unsigned int>(index.region->total_index()));
+        for (I k = 0; k < order.size(); ++k) {
+            index_sector_var.putVar({k}, static_cast<unsigned int>(index_set_->sector_of(order[k])->total_index()));
+            index_region_var.putVar({k}, static_cast<unsigned int>(index_set_->region_of(order[k])->total_index()));
         }
     }
     netCDF::NcVar flows_var = file.addVar("flows", netCDF::NcType::nc_FLOAT, {index_dim, index_dim});
     flows_var.setCompression(false, true, 7);
     flows_var.setFill<T>(true, std::numeric_limits<T>::quiet_NaN());
-    flows_var.putVar(&data[0]);
+    if (index_set_->order() == IndexSet<I>::Order::REGION_MAJOR) {
+        flows_var.putVar(&data[0]);
+    } else {
+        std::vector<T> row(order.size());
+        for (I k = 0; k < order.size(); ++k) {
+            for (I l = 0; l < order.size(); ++l) {
+                row[l] = at(order[k], order[l]);
+            }
+            flows_var.putVar({k, 0}, {1, order.size()}, &row[0]);
+        }
+    }
 }
 #endif
 
@@ -372,13 +668,13 @@ void Table<T, I>::insert_sector_offset(const Sector<I>* i, const I& i_regions_co
         auto subregion = (*region)->sub().rbegin();
         I next;
         if (subregion == (*region)->sub().rend()) {
-            next = index_set_(i, *region);
+            next = (*index_set_)(i, *region);
         } else {
-            next = index_set_(i, *subregion);
+            next = (*index_set_)(i, *subregion);
         }
-        I new_size = index_set_.size() + i_regions_count * (subsectors_count - 1);
+        I new_size = index_set_->size() + i_regions_count * (subsectors_count - 1);
         I y_offset = new_size;
-        for (I y = index_set_.size(); y-- > 0;) {
+        for (I y = index_set_->size(); y-- > 0;) {
             if (y == next) {
                 y_offset -= subsectors_count;
                 if (subregion != (*region)->sub().rend()) {
@@ -391,13 +687,13 @@ void Table<T, I>::insert_sector_offset(const Sector<I>* i, const I& i_regions_co
                     } else {
                         subregion = (*region)->sub().rbegin();
                         if (subregion == (*region)->sub().rend()) {
-                            next = index_set_(i, *region);
+                            next = (*index_set_)(i, *region);
                         } else {
-                            next = index_set_(i, *subregion);
+                            next = (*index_set_)(i, *subregion);
                         }
                     }
                 } else {
-                    next = index_set_(i, *subregion);
+                    next = (*index_set_)(i, *subregion);
                 }
                 for (I offset = subsectors_count; offset-- > 0;) {
                     insert_sector_offset_row(i, i_regions_count, subsectors_count, y, y_offset + offset, subsectors_count);
@@ -418,13 +714,13 @@ void Table<T, I>::insert_sector_offset_row(
         auto subregion = (*region)->sub().rbegin();
         I next;
         if (subregion == (*region)->sub().rend()) {
-            next = index_set_(i, *region);
+            next = (*index_set_)(i, *region);
         } else {
-            next = index_set_(i, *subregion);
+            next = (*index_set_)(i, *subregion);
         }
-        I new_size = index_set_.size() + i_regions_count * (subsectors_count - 1);
+        I new_size = index_set_->size() + i_regions_count * (subsectors_count - 1);
         I x_offset = new_size;
-        for (I x = index_set_.size(); x-- > 0;) {
+        for (I x = index_set_->size(); x-- > 0;) {
             if (x == next) {
                 x_offset -= subsectors_count;
                 if (subregion != (*region)->sub().rend()) {
@@ -437,20 +733,20 @@ void Table<T, I>::insert_sector_offset_row(
                     } else {
                         subregion = (*region)->sub().rbegin();
                         if (subregion == (*region)->sub().rend()) {
-                            next = index_set_(i, *region);
+                            next = (*index_set_)(i, *region);
                         } else {
-                            next = index_set_(i, *subregion);
+                            next = (*index_set_)(i, *subregion);
                         }
                     }
                 } else {
-                    next = index_set_(i, *subregion);
+                    next = (*index_set_)(i, *subregion);
                 }
                 for (I offset = subsectors_count; offset-- > 0;) {
-                    data[y_offset * new_size + x_offset + offset] = data[y * index_set_.size() + x] / subsectors_count / divide_by;
+                    data[y_offset * new_size + x_offset + offset] = data[y * index_set_->size() + x] / subsectors_count / divide_by;
                 }
             } else {
                 --x_offset;
-                data[y_offset * new_size + x_offset] = data[y * index_set_.size() + x] / divide_by;
+                data[y_offset * new_size + x_offset] = data[y * index_set_->size() + x] / divide_by;
             }
         }
     }
@@ -463,21 +759,21 @@ void Table<T, I>::insert_region_offset(const Region<I>* r, const I& r_sectors_co
         auto last_subsector = (*last_sector)->sub().rbegin();
         I last_index;
         if (last_subsector == (*last_sector)->sub().rend()) {
-            last_index = index_set_(*last_sector, r);
+            last_index = (*index_set_)(*last_sector, r);
         } else {
-            last_index = index_set_(*last_subsector, r);
+            last_index = (*index_set_)(*last_subsector, r);
         }
         auto first_sector = r->sectors().begin();
         auto first_subsector = (*first_sector)->sub().begin();
         I first_index;
         if (first_subsector == (*first_sector)->sub().end()) {
-            first_index = index_set_(*first_sector, r);
+            first_index = (*index_set_)(*first_sector, r);
         } else {
-            first_index = index_set_(*first_subsector, r);
+            first_index = (*index_set_)(*first_subsector, r);
         }
-        I new_size = index_set_.size() + r_sectors_count * (subregions_count - 1);
-        for (I y = index_set_.size(); y-- > last_index + 1;) {
-            insert_region_offset_row(r, r_sectors_count, subregions_count, y, new_size + y - index_set_.size(), 1, first_index, last_index);
+        I new_size = index_set_->size() + r_sectors_count * (subregions_count - 1);
+        for (I y = index_set_->size(); y-- > last_index + 1;) {
+            insert_region_offset_row(r, r_sectors_count, subregions_count, y, new_size + y - index_set_->size(), 1, first_index, last_index);
         }
         for (I y = last_index + 1; y-- > first_index;) {
             for (I offset = subregions_count; offset-- > 0;) {
@@ -500,18 +796,16 @@ void Table<T, I>::insert_region_offset_row(const Region<I>* r,
                                            const I& first_index,
                                            const I& last_index) noexcept {
     (void)(r);
-    I new_size = index_set_.size() + r_sectors_count * (subregions_count - 1);
-    for (I x = index_set_.size(); x-- > last_index + 1;) {
-        data[y_offset * new_size + new_size + x - index_set_.size()] = data[y * index_set_.size() + x] / divide_by;
-    }
-    for (I x = last_index + 1; x-- > first_index;) {
-        for (I offset = subregions_count; offset-- > 0;) {
-            data[y_offset * new_size + x + offset * r_sectors_count] = data[y * index_set_.size() + x] / subregions_count / divide_by;
-        }
-    }
-    for (I x = first_index; x-- > 0;) {
-        data[y_offset * new_size + x] = data[y * index_set_.size() + x] / divide_by;
+    I new_size = index_set_->size() + r_sectors_count * (subregions_count - 1);
+    const T* from = &data[y * index_set_->size()];
+    T* to = &data[y_offset * new_size];
+    // targets never start before their sources, parts are handled from the end of the row and the first subregion last
+    kernels::divide(from + last_index + 1, to + new_size - index_set_->size() + last_index + 1, index_set_->size() - last_index - 1, static_cast<T>(divide_by));
+    for (I offset = subregions_count; offset-- > 0;) {
+        kernels::divide(from + first_index, to + first_index + offset * r_sectors_count, last_index + 1 - first_index,
+                        static_cast<T>(subregions_count * divide_by));
     }
+    kernels::divide(from, to, first_index, static_cast<T>(divide_by));
 }
 
 template<typename T, typename I>
@@ -519,17 +813,17 @@ void Table<T, I>::debug_out() const {
 #ifdef LIBMRIO_VERY_VERBOSE
     std::cout << "\n====\n";
     std::cout << std::setprecision(3) << std::fixed;
-    for (const auto& from : index_set_.total_indices) {
-        std::cout << index_set_.at(from.sector, from.region) << " " << from.sector->name << " "
+    for (const auto& from : index_set_->total_indices) {
+        std::cout << index_set_->at(from.sector, from.region) << " " << from.sector->name << " "
                   << (!from.sector->parent() ? "     " : from.sector->parent()->name) << " " << (from.sector->parent() ? *from.sector->parent() : *from.sector)
                   << " " << (*from.sector) << " " << from.sector->level_index() << " " << from.region->name << " "
                   << (!from.region->parent() ? "     " : from.region->parent()->name) << " " << (from.region->parent() ? *from.region->parent() : *from.region)
                   << " " << (*from.region) << " " << from.region->level_index() << "  |  ";
-        for (const auto& to : index_set_.total_indices) {
-            if (std::isnan(data[from.index * index_set_.size() + to.index])) {
+        for (const auto& to : index_set_->total_indices) {
+            if (std::isnan(data[from.index * index_set_->size() + to.index])) {
                 std::cout << " .   ";
             } else {
-                std::cout << data[from.index * index_set_.size() + to.index];
+                std::cout << data[from.index * index_set_->size() + to.index];
             }
             std::cout << " ";
         }
@@ -540,8 +834,8 @@ void Table<T, I>::debug_out() const {
 }
 
 template<typename T, typename I>
-void Table<T, I>::insert_subsectors(const std::string& name, const std::vector<std::string>& subsectors) {
-    const Sector<I>* sector = index_set_.sector(name);
+void Table<T, I>::insert_subsectors(const std::string& name, const std::vector<std::string>& subsectors, bool in_place) {
+    const Sector<I>* sector = index_set_->sector(name);
     const Sector<I>* i = sector->as_super();
     if (!i) {
         throw std::runtime_error("'" + name + "' is a subsector");
@@ -549,6 +843,12 @@ void Table<T, I>::insert_subsectors(const std::string& name, const std::vector<s
     if (i->has_sub()) {
         throw std::runtime_error("'" + name + "' already has subsectors");
     }
+    if (!in_place || has_marginals() || index_set_->order() != IndexSet<I>::Order::REGION_MAJOR) {
+        auto new_index_set = std::make_shared<IndexSet<I>>(*index_set_);
+        new_index_set->insert_subsectors(name, subsectors);
+        relayout(std::move(new_index_set), in_place);
+        return;
+    }
     I i_regions_count = 0;
     for (const auto& region : i->regions()) {
         if (region->has_sub()) {
@@ -558,18 +858,21 @@ void Table<T, I>::insert_subsectors(const std::string& name, const std::vector<s
         }
     }
     debug_out();
-    data.resize((index_set_.size() + i_regions_count * (subsectors.size() - 1)) * (index_set_.size() + i_regions_count * (subsectors.size() - 1)));
+    resize_zeroed(data, (index_set_->size() + i_regions_count * (subsectors.size() - 1)) * (index_set_->size() + i_regions_count * (subsectors.size() - 1)));
     // blowup table accordingly
     // and alter values in table (equal distribution)
     insert_sector_offset(i, i_regions_count, subsectors.size());
-    // alter indices
-    index_set_.insert_subsectors(name, subsectors);
+    // alter indices (on a copy, as the current index set might be shared)
+    auto new_index_set = std::make_shared<IndexSet<I>>(*index_set_);
+    new_index_set->insert_subsectors(name, subsectors);
+    index_set_ = std::move(new_index_set);
+    clear_sum_plans();
     debug_out();
 }
 
 template<typename T, typename I>
-void Table<T, I>::insert_subregions(const std::string& name, const std::vector<std::string>& subregions) {
-    const Region<I>* region = index_set_.region(name);
+void Table<T, I>::insert_subregions(const std::string& name, const std::vector<std::string>& subregions, bool in_place) {
+    const Region<I>* region = index_set_->region(name);
     const Region<I>* r = region->as_super();
     if (!r) {
         throw std::runtime_error("'" + name + "' is a subregion");
@@ -577,6 +880,12 @@ void Table<T, I>::insert_subregions(const std::string& name, const std::vector<s
     if (r->has_sub()) {
         throw std::runtime_error("'" + name + "' already has subregions");
     }
+    if (!in_place || has_marginals() || index_set_->order() != IndexSet<I>::Order::REGION_MAJOR) {
+        auto new_index_set = std::make_shared<IndexSet<I>>(*index_set_);
+        new_index_set->insert_subregions(name, subregions);
+        relayout(std::move(new_index_set), in_place);
+        return;
+    }
     I r_sectors_count = 0;
     for (const auto& sector : r->sectors()) {
         if (sector->has_sub()) {
@@ -586,17 +895,166 @@ void Table<T, I>::insert_subregions(const std::string& name, const std::vector<s
         }
     }
     debug_out();
-    data.resize((index_set_.size() + r_sectors_count * (subregions.size() - 1)) * (index_set_.size() + r_sectors_count * (subregions.size() - 1)));
+    resize_zeroed(data, (index_set_->size() + r_sectors_count * (subregions.size() - 1)) * (index_set_->size() + r_sectors_count * (subregions.size() - 1)));
     // blowup table accordingly
     // and alter values in table (equal distribution)
     insert_region_offset(r, r_sectors_count, subregions.size());
-    // alter indices
-    index_set_.insert_subregions(name, subregions);
+    // alter indices (on a copy, as the current index set might be shared)
+    auto new_index_set = std::make_shared<IndexSet<I>>(*index_set_);
+    new_index_set->insert_subregions(name, subregions);
+    index_set_ = std::move(new_index_set);
+    clear_sum_plans();
+    debug_out();
+}
+
+template<typename T, typename I>
+void Table<T, I>::relayout(std::shared_ptr<const IndexSet<I>> new_index_set_p, bool in_place) {
+    const IndexSet<I>& new_index_set = *new_index_set_p;
+    const I old_size = index_set_->size();
+    const I new_size = new_index_set.size();
+    // for every new index: old index it originates from and number of parts the old one is split into
+    std::vector<I> source(new_size);
+    std::vector<I> divide_by(new_size);
+    bool failed = false;  // exceptions cannot leave the parallel region, hence only flagged there
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < new_size; ++y) {
+        const Sector<I>* new_sector = new_index_set.sector_of(y);
+        const Region<I>* new_region = new_index_set.region_of(y);
+        const Sector<I>* sector = index_set_->find_sector(new_sector->super()->name);
+        const Region<I>* region = index_set_->find_region(new_region->super()->name);
+        divide_by[y] = 1;
+        if (sector && new_sector->is_sub()) {
+            if (sector->has_sub()) {
+                sector = index_set_->find_sector(new_sector->name);
+            } else {
+                divide_by[y] *= new_sector->parent()->sub().size();
+            }
+        }
+        if (region && new_region->is_sub()) {
+            if (region->has_sub()) {
+                region = index_set_->find_region(new_region->name);
+            } else {
+                divide_by[y] *= new_region->parent()->sub().size();
+            }
+        }
+        if (!sector || !region || sector->has_sub() || region->has_sub() || (*index_set_)(sector, region) == IndexSet<I>::NOT_GIVEN) {
+#pragma omp atomic write
+            failed = true;
+            continue;
+        }
+        source[y] = (*index_set_)(sector, region);
+    }
+    if (failed) {
+        throw std::runtime_error("Index set is not a disaggregation of this table's index set");
+    }
+    if (has_marginals()) {
+        // splitting an index evenly splits its totals as well
+        std::vector<accumulator_type> new_row_totals(new_size);
+        std::vector<accumulator_type> new_col_totals(new_size);
+        for (I y = 0; y < new_size; ++y) {
+            new_row_totals[y] = row_totals_[source[y]] / divide_by[y];
+            new_col_totals[y] = col_totals_[source[y]] / divide_by[y];
+        }
+        row_totals_.swap(new_row_totals);
+        col_totals_.swap(new_col_totals);
+    }
     debug_out();
+    // split columns into runs of consecutive source indices with same divisor so that rows can be filled run-wise
+    struct Run {
+        I begin;
+        I source_begin;
+        I length;
+        I divide_by;
+    };
+    std::vector<Run> runs;
+    for (I x = 0; x < new_size; ++x) {
+        if (!runs.empty() && runs.back().divide_by == divide_by[x] && runs.back().source_begin + runs.back().length == source[x]) {
+            ++runs.back().length;
+        } else {
+            runs.push_back({x, source[x], 1, divide_by[x]});
+        }
+    }
+    // the backwards copy below needs source to be non-decreasing, which does not hold when the order changes
+    if (in_place && std::is_sorted(std::begin(source), std::end(source))) {
+        resize_zeroed(data, new_size * new_size);
+        // source[y] <= y for all y, hence going backwards never overwrites values still to be read
+        for (I y = new_size; y-- > 0;) {
+            const T* from = &data[source[y] * old_size];
+            T* to = &data[y * new_size];
+            for (auto run = std::rbegin(runs); run != std::rend(runs); ++run) {
+                const I run_divide_by = divide_by[y] * run->divide_by;
+                if (run_divide_by == 1) {
+                    std::copy_backward(from + run->source_begin, from + run->source_begin + run->length, to + run->begin + run->length);
+                } else {
+                    for (I x = run->length; x-- > 0;) {
+                        to[run->begin + x] = from[run->source_begin + x] / static_cast<T>(run_divide_by);
+                    }
+                }
+            }
+        }
+    } else {
+        data_type new_data(new_size * new_size);
+#pragma omp parallel for default(shared) schedule(static)
+        for (I y = 0; y < new_size; ++y) {
+            const T* from = &data[source[y] * old_size];
+            T* to = &new_data[y * new_size];
+            for (const auto& run : runs) {
+                const I run_divide_by = divide_by[y] * run.divide_by;
+                if (run_divide_by == 1) {
+                    std::copy(from + run.source_begin, from + run.source_begin + run.length, to + run.begin);
+                } else {
+                    kernels::divide(from + run.source_begin, to + run.begin, run.length, static_cast<T>(run_divide_by));
+                }
+            }
+        }
+        data.swap(new_data);
+    }
+    index_set_ = std::move(new_index_set_p);
+    clear_sum_plans();
+    debug_out();
+}
+
+template<typename T, typename I>
+void Table<T, I>::replace_table_from(const Table& other) {
+    if (data.size() != other.data.size()) {
+        data_type new_data(other.data.size());
+        data.swap(new_data);
+    }
+    const I n = other.index_set_->size();
+    // rows are copied with the same partitioning as other row-wise loops, so that pages of a new buffer are first touched by the threads using them
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        std::copy(&other.data[y * n], &other.data[y * n] + n, &data[y * n]);
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::set_index_order(typename IndexSet<I>::Order order) {
+    if (order != index_set_->order()) {
+        auto new_index_set = std::make_shared<IndexSet<I>>(*index_set_);
+        new_index_set->set_order(order);
+        relayout(std::move(new_index_set), false);
+    }
+}
+
+template<typename T, typename I>
+void Table<T, I>::insert_subs_from(const IndexSet<I>& new_index_set, bool in_place) {
+    insert_subs_from(std::make_shared<const IndexSet<I>>(new_index_set), in_place);
+}
+
+template<typename T, typename I>
+void Table<T, I>::insert_subs_from(std::shared_ptr<const IndexSet<I>> new_index_set, bool in_place) {
+    if (new_index_set->supersectors().size() != index_set_->supersectors().size()
+        || new_index_set->superregions().size() != index_set_->superregions().size()) {
+        throw std::runtime_error("Index set is not a disaggregation of this table's index set");
+    }
+    relayout(std::move(new_index_set), in_place);
 }
 
 template class Table<float, std::size_t>;
 template class Table<double, std::size_t>;
 template class Table<int, std::size_t>;
+template class Table<float, std::uint32_t>;
+template class Table<double, std::uint32_t>;
 
 }  // namespace mrio
@@ -19,6 +19,7 @@
 
 #include "ProxyData.h"
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <limits>
@@ -28,6 +29,7 @@
 #include <vector>
 #include "MRIOTable.h"
 #include "csv-parser.h"
+#include "mapping.h"
 #include "progressbar.h"
 #include "settingsnode.h"
 
@@ -72,6 +74,32 @@ std::size_t DebugGroupGuard::debug_group_level = 0;
 
 namespace mrio {
 
+template<typename I>
+FullIndices<I>::FullIndices(const IndexSet<I>& index_set) {
+    for (const auto& ir : index_set.super_indices) {
+        if (supers.size() == std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Too many super indices");
+        }
+        if (ir.sector->has_sub() || ir.region->has_sub()) {
+            disaggregated.push_back(supers.size());
+        } else {
+            non_disaggregated.push_back(supers.size());
+        }
+        supers.push_back({ir.sector, ir.region});
+    }
+    disaggregated_rows_size = disaggregated.size() * supers.size();
+}
+
+template<typename I>
+template<typename T>
+FullIndices<I>::FullIndices(const IndexSet<I>& index_set, const Table<T, I>& basetable) : FullIndices(index_set) {
+    occupied_.resize(size());
+    for (std::size_t k = 0; k < occupied_.size(); ++k) {
+        const auto full_index = (*this)[k];
+        occupied_[k] = basetable.base(full_index.i, full_index.r, full_index.j, full_index.s) != 0;
+    }
+}
+
 template<typename T, typename I>
 void ProxyData<T, I>::set_clusters_for_foreign(MappingIndexPart* foreign_index_part) {
     foreign_index_part->foreign_cluster->insert(foreign_index_part);
@@ -103,11 +131,6 @@ void ProxyData<T, I>::set_clusters_for_native(MappingIndexPart* native_index_par
 template<typename T, typename I>
 void ProxyData<T, I>::read_mapping_from_file(const settings::SettingsNode& mapping_node, ProxyIndex& index) {
     const auto& filename = mapping_node["file"].as<std::string>();
-    std::ifstream file(filename);
-    if (!file) {
-        throw std::runtime_error("Could not open mapping file " + filename);
-    }
-
     switch (index.type) {
         case ProxyIndex::Type::SECTOR:
             index.native_indices.reserve(table_indices.supersectors().size());
@@ -135,104 +158,44 @@ void ProxyData<T, I>::read_mapping_from_file(const settings::SettingsNode& mappi
             break;
     }
 
-    try {
-        csv::Parser in(file);
-        std::size_t foreign_column = 0;
-        std::size_t native_column = 0;
-        {
-            bool foreign_column_found = false;
-            bool native_column_found = false;
-            const auto& foreign_column_name = mapping_node["foreign_column"].as<std::string>();
-            const auto& native_column_name = mapping_node["native_column"].as<std::string>();
-            std::size_t i = 0;
-            do {
-                const auto& name = in.read<std::string>();
-                if (name == foreign_column_name) {
-                    foreign_column = i;
-                    foreign_column_found = true;
-                    if (native_column_found) {
-                        break;
-                    }
-                } else if (name == native_column_name) {
-                    native_column = i;
-                    native_column_found = true;
-                    if (foreign_column_found) {
-                        break;
-                    }
-                }
-                ++i;
-            } while (in.next_col());
-            if (!foreign_column_found) {
-                throw std::runtime_error("Column " + foreign_column_name + " not found in " + filename);
-            }
-            if (!native_column_found) {
-                throw std::runtime_error("Column " + native_column_name + " not found in " + filename);
-            }
-        }
-
-        while (in.next_row()) {
-            for (std::size_t i = 0; i < std::min(foreign_column, native_column); ++i) {
-                in.next_col();
-            }
-            auto a = in.read_and_next<std::string>();
-            if (a == "-") {
-                continue;
-            }
-            for (std::size_t i = std::min(foreign_column, native_column) + 1; i < std::max(foreign_column, native_column); ++i) {
-                in.next_col();
-            }
-            auto b = in.read_and_next<std::string>();
-            if (b == "-") {
-                continue;
-            }
-            std::string foreign_id;
-            std::string native_id;
-            if (foreign_column < native_column) {
-                foreign_id = a;
-                native_id = b;
-            } else {
-                native_id = a;
-                foreign_id = b;
-            }
-            MappingIndexPart* foreign_index_part;
-            auto foreign_it = index.foreign_indices_map.find(foreign_id);
-            if (foreign_it == std::end(index.foreign_indices_map)) {
+    mrio::read_mapping_from_file(mapping_node, [&](const std::string& foreign_id, const std::string& native_id) {
+        MappingIndexPart* foreign_index_part;
+        auto foreign_it = index.foreign_indices_map.find(foreign_id);
+        if (foreign_it == std::end(index.foreign_indices_map)) {
 #ifdef LIBMRIO_VERBOSE
-                foreign_index_part = new MappingIndexPart{index.foreign_indices.size(), foreign_id};
+            foreign_index_part = new MappingIndexPart{static_cast<I>(index.foreign_indices.size()), foreign_id};
 #else
-                foreign_index_part = new MappingIndexPart{index.foreign_indices.size()};
+            foreign_index_part = new MappingIndexPart{static_cast<I>(index.foreign_indices.size())};
 #endif
-                index.foreign_indices.emplace_back(foreign_index_part);
-                index.foreign_indices_map.emplace(foreign_id, foreign_index_part);
-            } else {
-                foreign_index_part = foreign_it->second;
-            }
-            std::size_t native_index;
-            switch (index.type) {
-                case ProxyIndex::Type::SECTOR:
-                case ProxyIndex::Type::SUBSECTOR:
-                    try {
-                        native_index = table_indices.sector(native_id)->level_index();
-                        break;
-                    } catch (std::out_of_range& ex) {
-                        throw std::runtime_error("Sector " + native_id + " from " + filename + " not found");
-                    }
-                case ProxyIndex::Type::REGION:
-                case ProxyIndex::Type::SUBREGION:
-                    try {
-                        native_index = table_indices.region(native_id)->level_index();
-                        break;
-                    } catch (std::out_of_range& ex) {
-                        throw std::runtime_error("Region " + native_id + " from " + filename + " not found");
-                    }
-            }
-            auto native_index_part = index.native_indices[native_index].get();
-            foreign_index_part->mapped_to.insert(native_index_part);
-            native_index_part->mapped_to.insert(foreign_index_part);
+            index.foreign_indices.emplace_back(foreign_index_part);
+            index.foreign_names.push_back(foreign_id);
+            index.foreign_indices_map.emplace(index.foreign_names.back(), foreign_index_part);
+        } else {
+            foreign_index_part = foreign_it->second;
         }
-    } catch (const csv::parser_exception& ex) {
-        throw std::runtime_error(ex.format(filename));
-    }
+        std::size_t native_index;
+        switch (index.type) {
+            case ProxyIndex::Type::SECTOR:
+            case ProxyIndex::Type::SUBSECTOR: {
+                const Sector<I>* sector = table_indices.find_sector(native_id);
+                if (!sector) {
+                    throw std::runtime_error("Sector " + native_id + " from " + filename + " not found");
+                }
+                native_index = sector->level_index();
+            } break;
+            case ProxyIndex::Type::REGION:
+            case ProxyIndex::Type::SUBREGION: {
+                const Region<I>* region = table_indices.find_region(native_id);
+                if (!region) {
+                    throw std::runtime_error("Region " + native_id + " from " + filename + " not found");
+                }
+                native_index = region->level_index();
+            } break;
+        }
+        auto native_index_part = index.native_indices[native_index].get();
+        foreign_index_part->mapped_to.insert(native_index_part);
+        native_index_part->mapped_to.insert(foreign_index_part);
+    });
 
     for (auto& native_index_part : index.native_indices) {
         if (native_index_part->mapped_to.size() > 0 && !native_index_part->native_cluster) {
@@ -260,6 +223,27 @@ void ProxyData<T, I>::read_mapping_from_file(const settings::SettingsNode& mappi
     }
 }
 
+template<typename T, typename I>
+std::size_t ProxyData<T, I>::find_index(const ProxyIndex& index, std::string_view name) const noexcept {
+    if (index.mapped) {
+        const auto it = index.foreign_indices_map.find(name);
+        return it == std::end(index.foreign_indices_map) ? NOT_FOUND : it->second->index;
+    }
+    switch (index.type) {
+        case ProxyIndex::Type::SECTOR:
+        case ProxyIndex::Type::SUBSECTOR: {
+            const Sector<I>* sector = table_indices.find_sector(name);
+            return sector ? sector->level_index() : NOT_FOUND;
+        }
+        case ProxyIndex::Type::REGION:
+        case ProxyIndex::Type::SUBREGION: {
+            const Region<I>* region = table_indices.find_region(name);
+            return region ? region->level_index() : NOT_FOUND;
+        }
+    }
+    return NOT_FOUND;
+}
+
 template<typename T, typename I>
 void ProxyData<T, I>::read_from_file(const settings::SettingsNode& settings_node) {
     debug("");
@@ -357,54 +341,19 @@ void ProxyData<T, I>::read_from_file(const settings::SettingsNode& settings_node
                         value = in.read_and_next<T>();
                         break;
                     case Column::Type::INDEX: {
-                        auto str = in.read_and_next<std::string>();
-                        value_index *= column.index->size;
-                        switch (column.index->type) {
-                            case ProxyIndex::Type::SECTOR:
-                                try {
-                                    if (column.index->mapped) {
-                                        value_index += column.index->foreign_indices_map.at(str)->index;
-                                    } else {
-                                        value_index += table_indices.sector(str)->level_index();
-                                    }
-                                } catch (std::out_of_range& ex) {
-                                    throw std::runtime_error("Sector " + str + " from " + filename + " not found");
-                                }
-                                break;
-                            case ProxyIndex::Type::SUBSECTOR:
-                                try {
-                                    if (column.index->mapped) {
-                                        value_index += column.index->foreign_indices_map.at(str)->index;
-                                    } else {
-                                        value_index += table_indices.sector(str)->level_index();
-                                    }
-                                } catch (std::out_of_range& ex) {
+                        const auto str = in.read_and_next<std::string>();
+                        const std::size_t found = find_index(*column.index, str);
+                        if (found == NOT_FOUND) {
+                            switch (column.index->type) {
+                                case ProxyIndex::Type::SECTOR:
+                                case ProxyIndex::Type::SUBSECTOR:
                                     throw std::runtime_error("Sector " + str + " from " + filename + " not found");
-                                }
-                                break;
-                            case ProxyIndex::Type::REGION:
-                                try {
-                                    if (column.index->mapped) {
-                                        value_index += column.index->foreign_indices_map.at(str)->index;
-                                    } else {
-                                        value_index += table_indices.region(str)->level_index();
-                                    }
-                                } catch (std::out_of_range& ex) {
+                                case ProxyIndex::Type::REGION:
+                                case ProxyIndex::Type::SUBREGION:
                                     throw std::runtime_error("Region " + str + " from " + filename + " not found");
-                                }
-                                break;
-                            case ProxyIndex::Type::SUBREGION:
-                                try {
-                                    if (column.index->mapped) {
-                                        value_index += column.index->foreign_indices_map.at(str)->index;
-                                    } else {
-                                        value_index += table_indices.region(str)->level_index();
-                                    }
-                                } catch (std::out_of_range& ex) {
-                                    throw std::runtime_error("Region " + str + " from " + filename + " not found");
-                                }
-                                break;
+                            }
                         }
+                        value_index = value_index * column.index->size + found;
                     } break;
                 }
                 if (skip) {
@@ -480,7 +429,7 @@ inline T ProxyData<T, I>::sum_proxy_over_all_foreign_clusters_helper(I index,
                                                                      const Region<I>* r_p,
                                                                      const Sector<I>* j_p,
                                                                      const Region<I>* s_p) const {
-    T res = 0;
+    typename Table<T, I>::accumulator_type res = 0;
     index *= proxy_index->size;
     if (proxy_index->mapped) {
         const auto& cluster = proxy_index->native_indices[level_index]->foreign_cluster;
@@ -536,7 +485,7 @@ T ProxyData<T, I>::get_mapped_value(
     if (!std::isnan(proxy_value)) {
         if (application->i != nullptr && application->i->mapped) {
             debug("i has mapping -> calc flow mapping share (" << debugp(i_p, r_p, j_p, s_p) << ")");
-            T sum = 0;
+            typename Table<T, I>::accumulator_type sum = 0;
             const auto& cluster = application->i->native_indices[i_p->level_index()]->native_cluster;
             if (!cluster) {
                 debug(i_p->name << " not in mapping");
@@ -561,7 +510,7 @@ T ProxyData<T, I>::get_mapped_value(
         }
         if (application->r != nullptr && application->r->mapped) {
             debug("r has mapping -> calc flow mapping share (" << debugp(i_p, r_p, j_p, s_p) << ")");
-            T sum = 0;
+            typename Table<T, I>::accumulator_type sum = 0;
             const auto& cluster = application->r->native_indices[r_p->level_index()]->native_cluster;
             if (!cluster) {
                 debug(r_p->name << " not in mapping");
@@ -586,7 +535,7 @@ T ProxyData<T, I>::get_mapped_value(
         }
         if (application->j != nullptr && application->j->mapped) {
             debug("j has mapping -> calc flow mapping share (" << debugp(i_p, r_p, j_p, s_p) << ")");
-            T sum = 0;
+            typename Table<T, I>::accumulator_type sum = 0;
             const auto& cluster = application->j->native_indices[j_p->level_index()]->native_cluster;
             if (!cluster) {
                 debug(j_p->name << " not in mapping");
@@ -611,7 +560,7 @@ T ProxyData<T, I>::get_mapped_value(
         }
         if (application->s != nullptr && application->s->mapped) {
             debug("s has mapping -> calc flow mapping share (" << debugp(i_p, r_p, j_p, s_p) << ")");
-            T sum = 0;
+            typename Table<T, I>::accumulator_type sum = 0;
             const auto& cluster = application->s->native_indices[s_p->level_index()]->native_cluster;
             if (!cluster) {
                 debug(s_p->name << " not in mapping");
@@ -639,7 +588,7 @@ T ProxyData<T, I>::get_mapped_value(
 }
 
 template<typename T, typename I>
-inline T ProxyData<T, I>::Application::get_flow(
+inline typename Table<T, I>::accumulator_type ProxyData<T, I>::Application::get_flow(
     const Table<T, I>& table, const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const {
     const auto i_e = (i == nullptr) ? i_p : (i->sub ? i_p->parent() : i_p);
     const auto r_e = (r == nullptr) ? r_p : (r->sub ? r_p->parent() : r_p);
@@ -651,7 +600,7 @@ inline T ProxyData<T, I>::Application::get_flow(
 }
 
 template<typename T, typename I>
-inline T ProxyData<T, I>::Application::get_flow_share_denominator(
+inline typename Table<T, I>::accumulator_type ProxyData<T, I>::Application::get_flow_share_denominator(
     const Table<T, I>& table, const Sector<I>* i_p, const Region<I>* r_p, const Sector<I>* j_p, const Region<I>* s_p) const {
     const auto i_d = (i == nullptr) ? nullptr : i_p->super();
     const auto r_d = (r == nullptr) ? nullptr : r_p->super();
@@ -711,89 +660,144 @@ ProxyData<T, I>::Application::Application(Application* application1, Application
 }
 
 template<typename T, typename I>
-void ProxyData<T, I>::approximate(
-    const std::vector<FullIndex<I>>& full_indices, Table<T, I>& table, Table<std::size_t, I> quality, const Table<T, I>& last_table, std::size_t d) const {
-#ifdef LIBMRIO_SHOW_PROGRESS
-    progressbar::ProgressBar bar(full_indices.size(), "    Approximation");
-#endif
-#pragma omp parallel for default(shared) schedule(guided)
-    for (std::size_t k = 0; k < full_indices.size(); ++k) {
-        const auto& full_index = full_indices[k];
-        const auto i_p = full_index.i;
-        const auto r_p = full_index.r;
-        const auto j_p = full_index.j;
-        const auto s_p = full_index.s;
-
-        Application* application1 = nullptr;
-        Application* application2 = nullptr;
-        for (const auto& app : applications) {
-            if (app->applies_to(i_p, r_p, j_p, s_p)) {
-                if (application1 == nullptr) {
-                    application1 = app.get();
-                } else if (application2 == nullptr) {
-                    application2 = app.get();
-                } else {
-                    throw std::runtime_error("More than two applications apply to " + i_p->name + ":" + r_p->name + "->" + j_p->name + ":" + s_p->name);
-                }
+inline void ProxyData<T, I>::approximate_block(
+    const FullIndex<I>& full_index, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& last_table, std::uint8_t d) const {
+    const auto i_p = full_index.i;
+    const auto r_p = full_index.r;
+    const auto j_p = full_index.j;
+    const auto s_p = full_index.s;
+
+    Application* application1 = nullptr;
+    Application* application2 = nullptr;
+    for (const auto& app : applications) {
+        if (app->applies_to(i_p, r_p, j_p, s_p)) {
+            if (application1 == nullptr) {
+                application1 = app.get();
+            } else if (application2 == nullptr) {
+                application2 = app.get();
+            } else {
+                throw std::runtime_error("More than two applications apply to " + i_p->name + ":" + r_p->name + "->" + j_p->name + ":" + s_p->name);
             }
         }
+    }
+
+    if (application1 == nullptr) {
+        return;
+    }
 
-        if (application1 == nullptr) {
-            continue;
+    if (application2 == nullptr) {
+        const auto denominator = application1->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
+        if (denominator <= 0 || std::isnan(denominator)) {
+            return;
         }
 
-        if (application2 == nullptr) {
-            const auto denominator = application1->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
-            if (denominator <= 0 || std::isnan(denominator)) {
-                continue;
+        // shares and values stay in accumulator precision, only rounded when stored
+        for_all_sub<T, I>(i_p, r_p, j_p, s_p, [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
+            const auto share = get_mapped_value(application1, last_table, i, r, j, s) / denominator;
+            if (!std::isnan(share)) {
+                const auto value = application1->get_flow(last_table, i, r, j, s) * share;
+                if (!std::isnan(value)) {
+                    assert(value >= 0);
+                    table(i, r, j, s) = static_cast<T>(value);
+                    quality(i, r, j, s) = d;
+                }
             }
+        });
+        return;
+    }
 
-            for_all_sub<T, I>(i_p, r_p, j_p, s_p, [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-                const auto share = get_mapped_value(application1, last_table, i, r, j, s) / denominator;
-                if (!std::isnan(share)) {
-                    const auto value = application1->get_flow(last_table, i, r, j, s) * share;
-                    if (!std::isnan(value)) {
-                        assert(value >= 0);
-                        table(i, r, j, s) = value;
-                        quality(i, r, j, s) = d;
-                    }
-                }
-            });
-            continue;
-        }
+    const auto denominator1 = application1->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
+    if (denominator1 <= 0 || std::isnan(denominator1)) {
+        return;
+    }
 
-        const auto denominator1 = application1->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
-        if (denominator1 <= 0 || std::isnan(denominator1)) {
-            continue;
-        }
+    const auto denominator2 = application2->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
+    if (denominator2 <= 0 || std::isnan(denominator2)) {
+        return;
+    }
 
-        const auto denominator2 = application2->get_flow_share_denominator(last_table, i_p, r_p, j_p, s_p);
-        if (denominator2 <= 0 || std::isnan(denominator2)) {
-            continue;
-        }
+    Application application_combo{application1, application2};
 
-        Application application_combo{application1, application2};
+    for_all_sub<T, I>(i_p, r_p, j_p, s_p, [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
+        typename Table<T, I>::accumulator_type value;
+        auto share1 = get_mapped_value(application1, last_table, i, r, j, s) / denominator1;
+        auto share2 = get_mapped_value(application2, last_table, i, r, j, s) / denominator2;
+        if (std::isnan(share1)) {
+            if (std::isnan(share2)) {
+                return;
+            }
+            value = application2->get_flow(last_table, i, r, j, s) * share2;
+        } else if (std::isnan(share2)) {
+            value = application1->get_flow(last_table, i, r, j, s) * share1;
+        } else {
+            value = application_combo.get_flow(last_table, i, r, j, s) * share1 * share2;
+        }
+        if (!std::isnan(value)) {
+            assert(value >= 0);
+            table(i, r, j, s) = static_cast<T>(value);
+            quality(i, r, j, s) = d;
+        }
+    });
+}
 
-        for_all_sub<T, I>(i_p, r_p, j_p, s_p, [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-            T value;
-            auto share1 = get_mapped_value(application1, last_table, i, r, j, s) / denominator1;
-            auto share2 = get_mapped_value(application2, last_table, i, r, j, s) / denominator2;
-            if (std::isnan(share1)) {
-                if (std::isnan(share2)) {
-                    return;
+template<typename T, typename I>
+inline void ProxyData<T, I>::adjust_block(
+    const FullIndex<I>& full_index, Table<T, I>& table, const Table<std::uint8_t, I>& quality, const Table<T, I>& basetable, std::uint8_t d) const {
+    const T& base = basetable.base(full_index.i, full_index.r, full_index.j, full_index.s);
+    if (base > 0) {
+        typename Table<T, I>::accumulator_type sum_of_exact = 0;
+        typename Table<T, I>::accumulator_type sum_of_non_exact = 0;
+        const auto for_all_rows = [&](auto func) {
+            for_all_sub_spans(table.index_set(), full_index.i, full_index.r, full_index.j, full_index.s,
+                              [&](const typename IndexSet<I>::Span& rows, const typename IndexSet<I>::Span& cols) {
+                                  for (I y = rows.begin; y < rows.begin + rows.size; ++y) {
+                                      func(&table(y, cols.begin), &quality(y, cols.begin), cols.size);
+                                  }
+                              });
+        };
+        for_all_rows([&](const T* values, const std::uint8_t* qualities, const I& size) {
+            for (I x = 0; x < size; ++x) {
+                if (qualities[x] == d) {
+                    sum_of_exact += values[x];
+                } else {
+                    sum_of_non_exact += values[x];
                 }
-                value = application2->get_flow(last_table, i, r, j, s) * share2;
-            } else if (std::isnan(share2)) {
-                value = application1->get_flow(last_table, i, r, j, s) * share1;
-            } else {
-                value = application_combo.get_flow(last_table, i, r, j, s) * share1 * share2;
-            }
-            if (!std::isnan(value)) {
-                assert(value >= 0);
-                table(i, r, j, s) = value;
-                quality(i, r, j, s) = d;
             }
         });
+        assert(sum_of_exact > 0 || sum_of_non_exact > 0);
+        const typename Table<T, I>::accumulator_type correction_factor = base / (sum_of_exact + sum_of_non_exact);
+        if (base > sum_of_exact && sum_of_non_exact > 0) {
+            for_all_rows([&](T* values, const std::uint8_t* qualities, const I& size) {
+                for (I x = 0; x < size; ++x) {
+                    if (qualities[x] != d) {
+                        values[x] = (base - sum_of_exact) * values[x] / sum_of_non_exact;
+                    }
+                }
+            });
+        } else if (correction_factor < 1 || correction_factor > 1) {
+            for_all_rows([&](T* values, const std::uint8_t* /* qualities */, const I& size) {
+                for (I x = 0; x < size; ++x) {
+                    values[x] = correction_factor * values[x];
+                }
+            });
+        }
+    }
+}
+
+template<typename T, typename I>
+void ProxyData<T, I>::approximate(
+    const FullIndices<I>& full_indices, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& last_table, std::uint8_t d) const {
+#ifdef LIBMRIO_SHOW_PROGRESS
+    progressbar::ProgressBar bar(full_indices.size(), "    Approximation");
+#endif
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t k = 0; k < full_indices.size(); ++k) {
+        if (full_indices.occupied(k)) {
+            const auto full_index = full_indices[k];
+            table.remove_from_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
+            approximate_block(full_index, table, quality, last_table, d);
+            table.add_to_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
+        }
 #ifdef LIBMRIO_SHOW_PROGRESS
         ++bar;
 #endif
@@ -802,40 +806,43 @@ void ProxyData<T, I>::approximate(
 
 template<typename T, typename I>
 void ProxyData<T, I>::adjust(
-    const std::vector<FullIndex<I>>& full_indices, Table<T, I>& table, Table<std::size_t, I> quality, const Table<T, I>& basetable, std::size_t d) const {
+    const FullIndices<I>& full_indices, Table<T, I>& table, Table<std::uint8_t, I>& quality, const Table<T, I>& basetable, std::uint8_t d) const {
 #ifdef LIBMRIO_SHOW_PROGRESS
     progressbar::ProgressBar bar(full_indices.size(), "    Adjustment");
 #endif
-#pragma omp parallel for default(shared) schedule(guided)
+#pragma omp parallel for default(shared) schedule(dynamic)
     for (std::size_t k = 0; k < full_indices.size(); ++k) {
-        const auto& full_index = full_indices[k];
-        const T& base = basetable.base(full_index.i, full_index.r, full_index.j, full_index.s);
-        if (base > 0) {
-            T sum_of_exact = 0;
-            T sum_of_non_exact = 0;
-            for_all_sub<T, I>(full_index.i, full_index.r, full_index.j, full_index.s,
-                              [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-                                  if (quality(i, r, j, s) == d) {
-                                      sum_of_exact += table(i, r, j, s);
-                                  } else {
-                                      sum_of_non_exact += table(i, r, j, s);
-                                  }
-                              });
-            assert(sum_of_exact > 0 || sum_of_non_exact > 0);
-            T correction_factor = base / (sum_of_exact + sum_of_non_exact);
-            if (base > sum_of_exact && sum_of_non_exact > 0) {
-                for_all_sub<T, I>(full_index.i, full_index.r, full_index.j, full_index.s,
-                                  [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-                                      if (quality(i, r, j, s) != d) {
-                                          table(i, r, j, s) = (base - sum_of_exact) * table(i, r, j, s) / sum_of_non_exact;
-                                      }
-                                  });
-            } else if (correction_factor < 1 || correction_factor > 1) {
-                for_all_sub<T, I>(full_index.i, full_index.r, full_index.j, full_index.s,
-                                  [&](const Sector<I>* i, const Region<I>* r, const Sector<I>* j, const Region<I>* s) {
-                                      table(i, r, j, s) = correction_factor * table(i, r, j, s);
-                                  });
-            }
+        if (full_indices.occupied(k)) {
+            const auto full_index = full_indices[k];
+            table.remove_from_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
+            adjust_block(full_index, table, quality, basetable, d);
+            table.add_to_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
+        }
+#ifdef LIBMRIO_SHOW_PROGRESS
+        ++bar;
+#endif
+    }
+}
+
+template<typename T, typename I>
+void ProxyData<T, I>::approximate_and_adjust(const FullIndices<I>& full_indices,
+                                             Table<T, I>& table,
+                                             Table<std::uint8_t, I>& quality,
+                                             const Table<T, I>& last_table,
+                                             const Table<T, I>& basetable,
+                                             std::uint8_t d) const {
+#ifdef LIBMRIO_SHOW_PROGRESS
+    progressbar::ProgressBar bar(full_indices.size(), "    Approximation and adjustment");
+#endif
+    // approximation of a block only reads from last_table and blocks are disjoint, so each block can be adjusted right away
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t k = 0; k < full_indices.size(); ++k) {
+        if (full_indices.occupied(k)) {
+            const auto full_index = full_indices[k];
+            table.remove_from_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
+            approximate_block(full_index, table, quality, last_table, d);
+            adjust_block(full_index, table, quality, basetable, d);
+            table.add_to_marginals(full_index.i, full_index.r, full_index.j, full_index.s);
         }
 #ifdef LIBMRIO_SHOW_PROGRESS
         ++bar;
@@ -843,7 +850,15 @@ void ProxyData<T, I>::adjust(
     }
 }
 
+template class FullIndices<std::size_t>;
+template FullIndices<std::size_t>::FullIndices(const IndexSet<std::size_t>& index_set, const Table<double, std::size_t>& basetable);
+template FullIndices<std::size_t>::FullIndices(const IndexSet<std::size_t>& index_set, const Table<float, std::size_t>& basetable);
 template class ProxyData<double, std::size_t>;
 template class ProxyData<float, std::size_t>;
+template class FullIndices<std::uint32_t>;
+template FullIndices<std::uint32_t>::FullIndices(const IndexSet<std::uint32_t>& index_set, const Table<double, std::uint32_t>& basetable);
+template FullIndices<std::uint32_t>::FullIndices(const IndexSet<std::uint32_t>& index_set, const Table<float, std::uint32_t>& basetable);
+template class ProxyData<double, std::uint32_t>;
+template class ProxyData<float, std::uint32_t>;
 
 }  // namespace mrio
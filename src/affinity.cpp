@@ -0,0 +1,165 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "affinity.h"
+
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace mrio {
+
+#ifdef __linux__
+/**
+ * @brief Parses list like "0-3,8,10-11" as used in sysfs
+ */
+static std::vector<int> read_list(const std::string& filename) {
+    std::vector<int> res;
+    std::ifstream file(filename);
+    std::string part;
+    while (std::getline(file, part, ',')) {
+        if (part.empty() || part[0] == '\n') {
+            continue;
+        }
+        const auto dash = part.find('-');
+        const int first = std::stoi(part.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(part.substr(dash + 1));
+        for (int k = first; k <= last; ++k) {
+            res.push_back(k);
+        }
+    }
+    return res;
+}
+
+template<typename Func>
+static void for_all_threads(Func func) {
+#ifdef _OPENMP
+#pragma omp parallel default(shared)
+    { func(omp_get_thread_num()); }
+#else
+    func(0);
+#endif
+}
+#endif
+
+void set_memory_policy(MemoryPolicy policy) {
+    if (policy == MemoryPolicy::FIRST_TOUCH) {
+        return;
+    }
+#ifdef __linux__
+    const auto nodes = read_list("/sys/devices/system/node/online");
+    if (nodes.empty()) {
+        return;  // no NUMA information, hence nothing to interleave
+    }
+    constexpr std::size_t BITS = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(nodes.back() / BITS + 1, 0);
+    for (const auto& node : nodes) {
+        mask[node / BITS] |= 1UL << (node % BITS);
+    }
+    bool failed = false;
+    // memory policies are per thread, so set it in all OpenMP threads (including this one)
+    for_all_threads([&](int /* thread */) {
+        if (syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask.data(), mask.size() * BITS + 1) != 0) {
+#pragma omp atomic write
+            failed = true;
+        }
+    });
+    if (failed) {
+        throw std::runtime_error("Could not set interleaved memory policy");
+    }
+#else
+    throw std::runtime_error("Memory policies are not supported on this platform");
+#endif
+}
+
+void set_thread_affinity(ThreadAffinity affinity) {
+    if (affinity == ThreadAffinity::NONE) {
+        return;
+    }
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        throw std::runtime_error("Could not get CPU affinity");
+    }
+    std::vector<int> cpus;
+    if (affinity == ThreadAffinity::SPREAD) {
+        // take one allowed CPU of each node in turn
+        std::vector<std::vector<int>> node_cpus;
+        for (const auto& node : read_list("/sys/devices/system/node/online")) {
+            node_cpus.emplace_back();
+            for (const auto& cpu : read_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    node_cpus.back().push_back(cpu);
+                }
+            }
+        }
+        for (std::size_t k = 0;; ++k) {
+            bool added = false;
+            for (const auto& list : node_cpus) {
+                if (k < list.size()) {
+                    cpus.push_back(list[k]);
+                    added = true;
+                }
+            }
+            if (!added) {
+                break;
+            }
+        }
+    }
+    if (cpus.empty()) {  // CLOSE or no NUMA information
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    bool failed = false;
+    for_all_threads([&](int thread) {
+        if (thread == 0) {
+            return;  // the calling thread keeps its mask, which threads created by it later inherit
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[thread % cpus.size()], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+#pragma omp atomic write
+            failed = true;
+        }
+    });
+    if (failed) {
+        throw std::runtime_error("Could not set CPU affinity");
+    }
+#else
+    throw std::runtime_error("Thread affinity is not supported on this platform");
+#endif
+}
+
+}  // namespace mrio
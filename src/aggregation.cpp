@@ -0,0 +1,63 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "aggregation.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "MRIOTable.h"
+#include "mapping.h"
+#include "settingsnode.h"
+
+namespace mrio {
+
+static std::unordered_map<std::string, std::string> read_mapping(const settings::SettingsNode& mapping_node) {
+    std::unordered_map<std::string, std::string> res;
+    read_mapping_from_file(mapping_node, [&](const std::string& foreign_id, const std::string& native_id) {
+        const auto it = res.emplace(native_id, foreign_id);
+        if (!it.second && it.first->second != foreign_id) {
+            throw std::runtime_error(native_id + " from " + mapping_node["file"].as<std::string>() + " mapped to both " + it.first->second + " and "
+                                     + foreign_id);
+        }
+    });
+    return res;
+}
+
+template<typename T, typename I>
+Table<T, I> aggregate(const Table<T, I>& table, const settings::SettingsNode& settings_node) {
+    std::unordered_map<std::string, std::string> sector_map;
+    std::unordered_map<std::string, std::string> region_map;
+    if (settings_node.has("sectors")) {
+        sector_map = read_mapping(settings_node["sectors"]);
+    }
+    if (settings_node.has("regions")) {
+        region_map = read_mapping(settings_node["regions"]);
+    }
+    return table.aggregate(sector_map, region_map);
+}
+
+template Table<double, std::size_t> aggregate(const Table<double, std::size_t>& table, const settings::SettingsNode& settings_node);
+template Table<float, std::size_t> aggregate(const Table<float, std::size_t>& table, const settings::SettingsNode& settings_node);
+template Table<double, std::uint32_t> aggregate(const Table<double, std::uint32_t>& table, const settings::SettingsNode& settings_node);
+template Table<float, std::uint32_t> aggregate(const Table<float, std::uint32_t>& table, const settings::SettingsNode& settings_node);
+
+}  // namespace mrio
@@ -0,0 +1,103 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "allocator.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define LIBMRIO_USE_MMAP
+#endif
+
+namespace mrio {
+
+static std::atomic<bool> use_huge_pages{false};
+
+void set_huge_pages(bool enabled) noexcept { use_huge_pages = enabled; }
+
+bool huge_pages() noexcept { return use_huge_pages; }
+
+#ifdef LIBMRIO_USE_MMAP
+static constexpr std::size_t MMAP_THRESHOLD = 1 << 20;  ///< smaller blocks are taken from the heap
+static constexpr std::size_t HUGE_PAGE_SIZE = 2 << 20;  ///< size of transparent huge pages on x86-64
+
+static void* map_huge_pages(std::size_t size) {
+    // map more than needed and unmap the unaligned head and the tail
+    const std::size_t length = size + HUGE_PAGE_SIZE;
+    void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+    const auto begin = reinterpret_cast<std::uintptr_t>(mapped);
+    const auto aligned = (begin + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    const auto page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    const auto end = (aligned + size + page_size - 1) & ~(page_size - 1);  // as unmapped by deallocate_zeroed
+    if (aligned > begin) {
+        munmap(mapped, aligned - begin);
+    }
+    if (end < begin + length) {
+        munmap(reinterpret_cast<void*>(end), begin + length - end);
+    }
+    void* res = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(res, size, MADV_HUGEPAGE);  // failure just leaves regular pages
+#endif
+    return res;
+}
+#endif
+
+void* allocate_zeroed(std::size_t size) {
+#ifdef LIBMRIO_USE_MMAP
+    if (size >= MMAP_THRESHOLD) {
+        if (use_huge_pages) {
+            void* res = map_huge_pages(size);
+            if (res) {
+                return res;
+            }
+        }
+        void* res = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (res == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        return res;
+    }
+#endif
+    void* res = std::calloc(size == 0 ? 1 : size, 1);
+    if (!res) {
+        throw std::bad_alloc();
+    }
+    return res;
+}
+
+void deallocate_zeroed(void* p, std::size_t size) noexcept {
+#ifdef LIBMRIO_USE_MMAP
+    if (size >= MMAP_THRESHOLD) {
+        munmap(p, size);
+        return;
+    }
+#endif
+    std::free(p);
+}
+
+}  // namespace mrio
@@ -0,0 +1,177 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "balancing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MRIOTable.h"
+
+namespace mrio {
+
+static constexpr std::size_t COLUMN_TILE_SIZE = 256;  ///< number of columns handled together in column sweeps
+
+/**
+ * @brief Returns factor f with f * positive - negative / f = target
+ *        (0 if all positive values have to vanish, i.e. negative = 0 and target <= 0)
+ */
+template<typename T>
+static inline T gras_factor(const T& positive, const T& negative, const T& target) {
+    if (positive > 0) {
+        if (negative == 0) {
+            return std::max<T>(target, 0) / positive;
+        }
+        return (target + std::sqrt(target * target + 4 * positive * negative)) / (2 * positive);
+    }
+    if (negative > 0 && target < 0) {
+        return -negative / target;
+    }
+    return 1;
+}
+
+/**
+ * @brief Returns f * positive - negative / f, where negative / f is 0 for negative = 0
+ *        (f = 0 only occurs in that case)
+ */
+template<typename T>
+static inline T gras_total(const T& factor, const T& positive, const T& negative) {
+    return factor * positive - (negative > 0 ? negative / factor : 0);
+}
+
+/**
+ * @brief Returns deviation of a total from its target (relative unless the
+ *        target is 0), infinity for NaN so that it is never taken as converged
+ */
+template<typename T>
+static inline T deviation_from(const T& total, const T& target) {
+    const T res = target == 0 ? std::abs(total) : std::abs(total - target) / std::abs(target);
+    return std::isnan(res) ? std::numeric_limits<T>::infinity() : res;
+}
+
+template<typename T, typename I>
+I balance(Table<T, I>& table, const std::vector<T>& row_totals, const std::vector<T>& col_totals, const T& tolerance, const I& max_iterations) {
+    const I n = table.index_set().size();
+    if (row_totals.size() != n || col_totals.size() != n) {
+        throw std::runtime_error("Balancing totals have wrong size");
+    }
+    using accumulator_type = typename Table<T, I>::accumulator_type;
+    const auto Z = table.block(0, n, 0, n);
+    std::vector<T> r(n, 1);       // row factors
+    std::vector<T> s(n, 1);       // column factors
+    std::vector<T> s_next(n, 1);  // column factors of next iteration
+    std::vector<accumulator_type> positive(n);
+    std::vector<accumulator_type> negative(n);
+    I iteration = 0;
+    while (true) {
+        // row sweep
+        accumulator_type deviation = 0;
+#pragma omp parallel for default(shared) schedule(static) reduction(max : deviation)
+        for (std::size_t y = 0; y < n; ++y) {
+            const T* row = Z.row(y);
+            accumulator_type p = 0;
+            accumulator_type m = 0;
+#pragma omp simd reduction(+ : p, m)
+            for (I x = 0; x < n; ++x) {
+                p += static_cast<accumulator_type>(std::max<T>(row[x], 0)) * s[x];
+                // columns with factor 0 have no negative values
+                m += row[x] < 0 ? -static_cast<accumulator_type>(row[x]) / s[x] : 0;
+            }
+            const accumulator_type factor = gras_factor<accumulator_type>(p, m, row_totals[y]);
+            r[y] = factor;
+            deviation = std::max(deviation, deviation_from<accumulator_type>(gras_total(factor, p, m), row_totals[y]));
+        }
+        // column sweep with new row factors, tiles of columns being independent
+#pragma omp parallel for default(shared) schedule(static) reduction(max : deviation)
+        for (std::size_t x_begin = 0; x_begin < n; x_begin += COLUMN_TILE_SIZE) {
+            const I x_end = std::min<I>(x_begin + COLUMN_TILE_SIZE, n);
+            std::fill(std::begin(positive) + x_begin, std::begin(positive) + x_end, 0);
+            std::fill(std::begin(negative) + x_begin, std::begin(negative) + x_end, 0);
+            for (I y = 0; y < n; ++y) {
+                const T* row = Z.row(y);
+                const T r_y = r[y];
+#pragma omp simd
+                for (I x = x_begin; x < x_end; ++x) {
+                    positive[x] += static_cast<accumulator_type>(std::max<T>(row[x], 0)) * r_y;
+                    // rows with factor 0 have no negative values
+                    negative[x] += row[x] < 0 ? -static_cast<accumulator_type>(row[x]) / r_y : 0;
+                }
+            }
+            for (I x = x_begin; x < x_end; ++x) {
+                deviation = std::max(deviation, deviation_from<accumulator_type>(gras_total<accumulator_type>(s[x], positive[x], negative[x]), col_totals[x]));
+                s_next[x] = gras_factor<accumulator_type>(positive[x], negative[x], col_totals[x]);
+            }
+        }
+        // current factors meet row and column totals
+        if (deviation <= tolerance) {
+            break;
+        }
+        if (iteration == max_iterations) {
+            throw std::runtime_error("Balancing did not converge within " + std::to_string(max_iterations) + " iterations");
+        }
+        ++iteration;
+        std::swap(s, s_next);
+    }
+
+    // apply factors, so that rows and columns meet their totals within tolerance
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        T* row = Z.row(y);
+        for (I x = 0; x < n; ++x) {
+            if (row[x] > 0) {
+                row[x] *= r[y] * s[x];
+            } else if (row[x] < 0) {
+                row[x] /= r[y] * s[x];
+            }
+        }
+    }
+    if (table.has_marginals()) {
+        table.build_marginals();
+    }
+    return iteration;
+}
+
+template std::size_t balance(Table<double, std::size_t>& table,
+                             const std::vector<double>& row_totals,
+                             const std::vector<double>& col_totals,
+                             const double& tolerance,
+                             const std::size_t& max_iterations);
+template std::size_t balance(Table<float, std::size_t>& table,
+                             const std::vector<float>& row_totals,
+                             const std::vector<float>& col_totals,
+                             const float& tolerance,
+                             const std::size_t& max_iterations);
+template std::uint32_t balance(Table<double, std::uint32_t>& table,
+                               const std::vector<double>& row_totals,
+                               const std::vector<double>& col_totals,
+                               const double& tolerance,
+                               const std::uint32_t& max_iterations);
+template std::uint32_t balance(Table<float, std::uint32_t>& table,
+                               const std::vector<float>& row_totals,
+                               const std::vector<float>& col_totals,
+                               const float& tolerance,
+                               const std::uint32_t& max_iterations);
+
+}  // namespace mrio
@@ -22,15 +22,21 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <functional>
-#include <random>
+#include <limits>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "MRIOTable.h"
 #include "ProxyData.h"
+#include "balancing.h"
 #include "csv-parser.h"
 #ifdef LIBMRIO_SHOW_PROGRESS
 #include "progressbar.h"
@@ -40,9 +46,100 @@
 namespace mrio {
 
 template<typename T, typename I>
-Table<T, I> disaggregate(const Table<T, I>& basetable, const settings::SettingsNode& settings_node) {
-    Table<T, I> table{basetable};
+static void update_disaggregated_blocks(Table<T, I>& last_table, const Table<T, I>& table, const FullIndices<I>& full_indices) {
+    // values outside of the full indices are never changed by approximation or adjustment, so only these blocks need to be copied
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t k = 0; k < full_indices.size(); ++k) {
+        if (!full_indices.occupied(k)) {
+            continue;
+        }
+        const auto& full_index = full_indices[k];
+        for_all_sub_spans(table.index_set(), full_index.i, full_index.r, full_index.j, full_index.s,
+                          [&](const typename IndexSet<I>::Span& rows, const typename IndexSet<I>::Span& cols) {
+                              for (I y = rows.begin; y < rows.begin + rows.size; ++y) {
+                                  const T* from = &table(y, cols.begin);
+                                  std::copy(from, from + cols.size, &last_table(y, cols.begin));
+                              }
+                          });
+        if (last_table.has_aggregate_index()) {
+            last_table.update_aggregate_index(full_index.i, full_index.r, full_index.j, full_index.s);
+        }
+    }
+}
 
+template<typename T, typename I, typename A = typename Table<T, I>::accumulator_type>
+static A balance_deviation(const Table<T, I>& table, const Table<T, I>& basetable, const std::vector<A>& base_row_totals, const std::vector<A>& base_col_totals) {
+    std::vector<A> row_totals(base_row_totals.size(), 0);
+    std::vector<A> col_totals(base_col_totals.size(), 0);
+    for (const auto& index : table.index_set().total_indices) {
+        const auto base_index = basetable.index_set().base(index.sector->super(), index.region->super());
+        row_totals[base_index] += table.row_total(index.index);
+        col_totals[base_index] += table.col_total(index.index);
+    }
+    // relative deviation from totals of the basetable (absolute where these are zero, infinite for NaN so that it is never within tolerance)
+    const auto deviation = [](const A& value, const A& base) {
+        const A res = base == 0 ? std::abs(value) : std::abs(value - base) / std::abs(base);
+        return std::isnan(res) ? std::numeric_limits<A>::infinity() : res;
+    };
+    A res = 0;
+    for (std::size_t k = 0; k < row_totals.size(); ++k) {
+        res = std::max(res, deviation(row_totals[k], base_row_totals[k]));
+        res = std::max(res, deviation(col_totals[k], base_col_totals[k]));
+    }
+    return res;
+}
+
+template<typename T, typename I>
+static void balance_to_totals_from_file(Table<T, I>& table, const settings::SettingsNode& balancing_node) {
+    const bool keep_marginals = table.has_marginals();
+    if (!keep_marginals) {
+        table.build_marginals();
+    }
+    std::vector<T> row_totals(std::begin(table.row_totals()), std::end(table.row_totals()));  // totals not given in the file are kept
+    std::vector<T> col_totals(std::begin(table.col_totals()), std::end(table.col_totals()));
+    if (!keep_marginals) {
+        table.clear_marginals();
+    }
+    const auto& filename = balancing_node["file"].as<std::string>();
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open totals file " + filename);
+    }
+    try {
+        csv::Parser in(file);
+        do {
+            const auto c = in.read<std::string, std::string, T, T>();
+            const Sector<I>* sector = table.index_set().find_sector(std::get<0>(c));
+            const Region<I>* region = table.index_set().find_region(std::get<1>(c));
+            if (!sector || !region) {
+                throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " not found");
+            }
+            // totals refer to single indices, not to a super sector or region that has been disaggregated
+            if (sector->has_sub() || region->has_sub()) {
+                throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " has subs, use the sub indices instead");
+            }
+            const I index = table.index_set()(sector, region);
+            if (index == IndexSet<I>::NOT_GIVEN) {
+                throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " not found");
+            }
+            row_totals[index] = std::get<2>(c);
+            col_totals[index] = std::get<3>(c);
+        } while (in.next_row());
+    } catch (const csv::parser_exception& ex) {
+        throw std::runtime_error(ex.format(filename));
+    }
+    const auto iterations =
+        balance(table, row_totals, col_totals, balancing_node["tolerance"].as<T>(1e-6), balancing_node["max_iterations"].as<I>(1000));
+#ifdef LIBMRIO_SHOW_PROGRESS
+    std::cout << "Balancing: " << iterations << " iterations\n" << std::flush;
+#else
+    (void)iterations;
+#endif
+}
+
+template<typename T, typename I>
+Table<T, I> disaggregate(const Table<T, I>& basetable, const settings::SettingsNode& settings_node) {
+    auto index_set = std::make_shared<IndexSet<I>>(basetable.index_set());
     for (const auto& subs_node : settings_node["subs"].as_sequence()) {
         std::vector<std::string> subs;
         for (const auto& sub : subs_node["into"].as_sequence()) {
@@ -53,14 +150,14 @@ Table<T, I> disaggregate(const Table<T, I>& basetable, const settings::SettingsN
         switch (type) {
             case settings::hstring::hash("sector"):
                 try {
-                    table.insert_subsectors(id, subs);
+                    index_set->insert_subsectors(id, subs);
                 } catch (std::out_of_range& ex) {
                     throw std::runtime_error("Sector '" + id + "' not found");
                 }
                 break;
             case settings::hstring::hash("region"):
                 try {
-                    table.insert_subregions(id, subs);
+                    index_set->insert_subregions(id, subs);
                 } catch (std::out_of_range& ex) {
                     throw std::runtime_error("Region '" + id + "' not found");
                 }
@@ -68,44 +165,69 @@ Table<T, I> disaggregate(const Table<T, I>& basetable, const settings::SettingsN
                 throw std::runtime_error("Unknown type");
         }
     }
+    // order used during computation, output is written region-major unless set otherwise in the output node
+    const auto& index_order = settings_node["index_order"].as<std::string>("region_major");
+    if (index_order == "sector_major") {
+        index_set->set_order(IndexSet<I>::Order::SECTOR_MAJOR);
+    } else if (index_order == "clustered") {
+        index_set->set_order(IndexSet<I>::Order::CLUSTERED);
+    } else if (index_order != "region_major") {
+        throw std::runtime_error("Unknown index order '" + index_order + "'");
+    }
 
-    Table<T, I> last_table{table.index_set(), 0};  // table in disaggregation used for accessing d-1 values
-    Table<std::size_t, I> quality{table.index_set(), 0};
-
-    std::vector<FullIndex<I>> full_indices;
-    for (const auto& ir : table.index_set().super_indices) {
-        if (ir.sector->has_sub() || ir.region->has_sub()) {
-            for (const auto& js : table.index_set().super_indices) {
-                full_indices.emplace_back(FullIndex<I>{ir.sector, ir.region, js.sector, js.region});
-            }
-        } else {
-            for (const auto& js : table.index_set().super_indices) {
-                if (js.sector->has_sub() || js.region->has_sub()) {
-                    full_indices.emplace_back(FullIndex<I>{ir.sector, ir.region, js.sector, js.region});
-                }
-            }
-        }
+    Table<T, I> table{basetable};
+    const bool check_balance = settings_node.has("balance_tolerance");
+    std::vector<typename Table<T, I>::accumulator_type> base_row_totals;
+    std::vector<typename Table<T, I>::accumulator_type> base_col_totals;
+    if (check_balance) {
+        table.build_marginals();
+        base_row_totals = table.row_totals();
+        base_col_totals = table.col_totals();
     }
+    table.insert_subs_from(std::move(index_set), settings_node["in_place_relayout"].as<bool>(true));
 
-    {
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(std::begin(full_indices), std::end(full_indices), g);
+    Table<T, I> last_table{table.shared_index_set(), 0};  // table in disaggregation used for accessing d-1 values
+    last_table.replace_table_from(table);
+    if (settings_node["aggregate_index"].as<bool>(true)) {
+        last_table.build_aggregate_index();
     }
+    if (settings_node["sum_plans"].as<bool>(true)) {
+        last_table.build_sum_plans();
+    }
+    Table<std::uint8_t, I> quality{table.shared_index_set(), 0};  // proxy level d by which value has last been approximated (0 = none)
+
+    const FullIndices<I> full_indices{table.index_set(), basetable};  // blocks with zero base flow stay zero and are skipped
 
-    std::size_t d = 1;
+    std::uint8_t d = 1;
     for (const auto& proxy_node : settings_node["proxies"].as_sequence()) {
+        if (d == 0) {
+            throw std::runtime_error("Too many proxies");
+        }
 #ifdef LIBMRIO_SHOW_PROGRESS
-        std::cout << "Proxy " << d << ":\n" << std::flush;
+        std::cout << "Proxy " << static_cast<unsigned int>(d) << ":\n" << std::flush;
 #endif
-        ProxyData<T, I> proxy(table.index_set());
+        ProxyData<T, I> proxy(table.shared_index_set());
         proxy.read_from_file(proxy_node);
-        last_table.replace_table_from(table);
+        if (d > 1) {
+            update_disaggregated_blocks(last_table, table, full_indices);
+        }
+
+        proxy.approximate_and_adjust(full_indices, table, quality, last_table, basetable, d);
+        if (check_balance) {
+            const auto deviation = balance_deviation(table, basetable, base_row_totals, base_col_totals);
+#ifdef LIBMRIO_SHOW_PROGRESS
+            std::cout << "    Balance deviation: " << deviation << "\n" << std::flush;
+#endif
+            if (deviation > settings_node["balance_tolerance"].as<T>()) {
+                throw std::runtime_error("Table out of balance after proxy " + std::to_string(d));
+            }
+        }
 
-        proxy.approximate(full_indices, table, quality, last_table, d);
-        proxy.adjust(full_indices, table, quality, basetable, d);
+        ++d;  // wraps to 0 after the last representable level
+    }
 
-        ++d;
+    if (settings_node.has("balancing")) {
+        balance_to_totals_from_file(table, settings_node["balancing"]);
     }
 
     return table;
@@ -113,5 +235,7 @@ Table<T, I> disaggregate(const Table<T, I>& basetable, const settings::SettingsN
 
 template Table<double, std::size_t> disaggregate(const Table<double, std::size_t>& basetable, const settings::SettingsNode& settings_node);
 template Table<float, std::size_t> disaggregate(const Table<float, std::size_t>& basetable, const settings::SettingsNode& settings_node);
+template Table<double, std::uint32_t> disaggregate(const Table<double, std::uint32_t>& basetable, const settings::SettingsNode& settings_node);
+template Table<float, std::uint32_t> disaggregate(const Table<float, std::uint32_t>& basetable, const settings::SettingsNode& settings_node);
 
 }  // namespace mrio
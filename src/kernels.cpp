@@ -0,0 +1,76 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "kernels.h"
+
+#include <cstddef>
+#include <functional>
+
+#if defined(LIBMRIO_SIMD_DISPATCH) && defined(__x86_64__) && defined(__GNUC__) && !defined(__INTEL_COMPILER)
+#define LIBMRIO_KERNEL __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define LIBMRIO_KERNEL
+#endif
+
+namespace mrio {
+namespace kernels {
+
+template<typename T>
+static inline double sum_kernel(const T* values, std::size_t size) noexcept {
+    double res = 0;
+#pragma omp simd reduction(+ : res)
+    for (std::size_t k = 0; k < size; ++k) {
+        res += values[k];
+    }
+    return res;
+}
+
+template<typename T>
+static inline void divide_kernel(const T* from, T* to, std::size_t size, T divisor) noexcept {
+    if (std::less<const T*>()(from + size, to + 1) || std::less<const T*>()(to + size, from + 1)) {
+#pragma omp simd
+        for (std::size_t k = 0; k < size; ++k) {
+            to[k] = from[k] / divisor;
+        }
+    } else {
+        for (std::size_t k = size; k-- > 0;) {
+            to[k] = from[k] / divisor;
+        }
+    }
+}
+
+template<typename T>
+static inline void apply_threshold_kernel(T* values, std::size_t size, T threshold) noexcept {
+#pragma omp simd
+    for (std::size_t k = 0; k < size; ++k) {
+        values[k] = values[k] <= threshold ? 0 : values[k];
+    }
+}
+
+LIBMRIO_KERNEL double sum(const float* values, std::size_t size) noexcept { return sum_kernel(values, size); }
+LIBMRIO_KERNEL double sum(const double* values, std::size_t size) noexcept { return sum_kernel(values, size); }
+
+LIBMRIO_KERNEL void divide(const float* from, float* to, std::size_t size, float divisor) noexcept { divide_kernel(from, to, size, divisor); }
+LIBMRIO_KERNEL void divide(const double* from, double* to, std::size_t size, double divisor) noexcept { divide_kernel(from, to, size, divisor); }
+
+LIBMRIO_KERNEL void apply_threshold(float* values, std::size_t size, float threshold) noexcept { apply_threshold_kernel(values, size, threshold); }
+LIBMRIO_KERNEL void apply_threshold(double* values, std::size_t size, double threshold) noexcept { apply_threshold_kernel(values, size, threshold); }
+
+}  // namespace kernels
+}  // namespace mrio
@@ -0,0 +1,324 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "leontief.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MRIOTable.h"
+#include "csv-parser.h"
+#include "settingsnode.h"
+
+namespace mrio {
+
+static constexpr std::size_t BLOCK_SIZE = 64;  ///< edge length of tiles in the LU decomposition
+
+template<typename T, typename I>
+Table<T, I> technical_coefficients(const Table<T, I>& table, const std::vector<T>& final_demand) {
+    using accumulator_type = typename Table<T, I>::accumulator_type;
+    const I n = table.index_set().size();
+    if (final_demand.size() != n) {
+        throw std::runtime_error("Final demand has wrong size");
+    }
+    // total output is sold to intermediate use and to final demand (with the row totals alone the columns of a balanced table
+    // would sum to one, i.e. I - A would be singular)
+    std::vector<accumulator_type> output(n);
+    const auto Z = table.block(0, n, 0, n);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        output[y] = (table.has_marginals() ? table.row_totals()[y] : pairwise_sum<accumulator_type>(Z.row(y), n)) + final_demand[y];
+    }
+    Table<T, I> res{table.shared_index_set(), 0};
+    const auto A = res.block(0, n, 0, n);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        for (I x = 0; x < n; ++x) {
+            if (output[x] > 0) {
+                A(y, x) = Z(y, x) / output[x];
+            }
+        }
+    }
+    return res;
+}
+
+template<typename T, typename I>
+static void lu_decompose(const BlockView<T, I>& M) {
+    const I n = M.rows();
+    // for non-negative A, I - A has positive pivots exactly if A is productive
+    const T min_pivot = std::sqrt(std::numeric_limits<T>::epsilon());
+    for (I k_begin = 0; k_begin < n; k_begin += BLOCK_SIZE) {
+        const I k_end = std::min<I>(k_begin + BLOCK_SIZE, n);
+        // factorize panel of columns [k_begin, k_end) in one parallel region, the implicit barrier after each pivot's loop makes
+        // the next pivot visible to all threads (which thus all stop at the same one)
+        I failed_at = n;
+#pragma omp parallel default(shared)
+        for (I k = k_begin; k < k_end; ++k) {
+            const T pivot = M(k, k);
+            if (!(pivot >= min_pivot)) {
+#pragma omp single
+                failed_at = k;
+                break;
+            }
+            const T* pivot_row = M.row(k);
+#pragma omp for schedule(static)
+            for (std::size_t y = k + 1; y < n; ++y) {
+                T* row = M.row(y);
+                const T l = row[k] /= pivot;
+                for (I x = k + 1; x < k_end; ++x) {
+                    row[x] -= l * pivot_row[x];
+                }
+            }
+        }
+        if (failed_at < n) {
+            throw std::runtime_error("I - A is singular or A is not productive (no positive pivot at index " + std::to_string(failed_at) + ")");
+        }
+        if (k_end == n) {
+            break;
+        }
+        // rows [k_begin, k_end) of U right of the panel
+#pragma omp parallel for default(shared) schedule(static)
+        for (std::size_t x_begin = k_end; x_begin < n; x_begin += BLOCK_SIZE) {
+            const I x_end = std::min<I>(x_begin + BLOCK_SIZE, n);
+            for (I k = k_begin; k < k_end; ++k) {
+                const T* pivot_row = M.row(k);
+                for (I y = k + 1; y < k_end; ++y) {
+                    T* row = M.row(y);
+                    const T l = row[k];
+                    for (I x = x_begin; x < x_end; ++x) {
+                        row[x] -= l * pivot_row[x];
+                    }
+                }
+            }
+        }
+        // update of trailing matrix tile by tile
+#pragma omp parallel for default(shared) schedule(static) collapse(2)
+        for (std::size_t y_begin = k_end; y_begin < n; y_begin += BLOCK_SIZE) {
+            for (std::size_t x_begin = k_end; x_begin < n; x_begin += BLOCK_SIZE) {
+                const I y_end = std::min<I>(y_begin + BLOCK_SIZE, n);
+                const I x_end = std::min<I>(x_begin + BLOCK_SIZE, n);
+                for (I y = y_begin; y < y_end; ++y) {
+                    T* row = M.row(y);
+                    for (I k = k_begin; k < k_end; ++k) {
+                        const T l = row[k];
+                        const T* pivot_row = M.row(k);
+                        for (I x = x_begin; x < x_end; ++x) {
+                            row[x] -= l * pivot_row[x];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename T, typename I>
+Table<T, I> leontief_inverse(const Table<T, I>& coefficients) {
+    const I n = coefficients.index_set().size();
+    Table<T, I> lu{coefficients.shared_index_set(), 0};
+    const auto A = coefficients.block(0, n, 0, n);
+    const auto M = lu.block(0, n, 0, n);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        for (I x = 0; x < n; ++x) {
+            M(y, x) = (y == x ? 1 : 0) - A(y, x);
+        }
+    }
+    lu_decompose(M);
+
+    // solve L * U * X = identity, columns of X being independent
+    Table<T, I> res{coefficients.shared_index_set(), 0};
+    const auto X = res.block(0, n, 0, n);
+#pragma omp parallel for default(shared) schedule(dynamic)
+    for (std::size_t x_begin = 0; x_begin < n; x_begin += BLOCK_SIZE) {
+        const I x_end = std::min<I>(x_begin + BLOCK_SIZE, n);
+        // forward substitution with unit lower L (rows above x_begin stay zero)
+        for (I y = x_begin; y < n; ++y) {
+            T* row = X.row(y);
+            if (y < x_end) {
+                row[y] = 1;
+            }
+            const T* l = M.row(y);
+            for (I k = x_begin; k < y; ++k) {
+                const T* from = X.row(k);
+                for (I x = x_begin; x < x_end; ++x) {
+                    row[x] -= l[k] * from[x];
+                }
+            }
+        }
+        // backward substitution with U
+        for (I y = n; y-- > 0;) {
+            T* row = X.row(y);
+            const T* u = M.row(y);
+            for (I k = y + 1; k < n; ++k) {
+                const T* from = X.row(k);
+                for (I x = x_begin; x < x_end; ++x) {
+                    row[x] -= u[k] * from[x];
+                }
+            }
+            for (I x = x_begin; x < x_end; ++x) {
+                row[x] /= u[y];
+            }
+        }
+    }
+    return res;
+}
+
+template<typename T, typename I>
+std::vector<T> leontief_solve(const Table<T, I>& coefficients, const std::vector<T>& demand, const T& tolerance, const I& max_iterations) {
+    const I n = coefficients.index_set().size();
+    if (demand.size() != n) {
+        throw std::runtime_error("Demand has wrong size");
+    }
+    // compress non-zero coefficients row-wise, as disaggregated tables are mostly sparse
+    const auto A = coefficients.block(0, n, 0, n);
+    std::vector<I> row_begin(n + 1, 0);
+    for (I y = 0; y < n; ++y) {
+        row_begin[y + 1] = row_begin[y] + std::count_if(A.row(y), A.row(y) + n, [](const T& v) { return v != 0; });
+    }
+    std::vector<I> cols(row_begin[n]);
+    std::vector<T> values(row_begin[n]);
+#pragma omp parallel for default(shared) schedule(static)
+    for (std::size_t y = 0; y < n; ++y) {
+        I k = row_begin[y];
+        for (I x = 0; x < n; ++x) {
+            if (A(y, x) != 0) {
+                cols[k] = x;
+                values[k] = A(y, x);
+                ++k;
+            }
+        }
+    }
+
+    using accumulator_type = typename Table<T, I>::accumulator_type;
+    std::vector<accumulator_type> res(std::begin(demand), std::end(demand));
+    std::vector<T> term(demand);
+    std::vector<T> next_term(n);
+    for (I iteration = 0; iteration < max_iterations; ++iteration) {
+        accumulator_type term_max = 0;
+        accumulator_type res_max = 0;
+        bool diverged = false;
+#pragma omp parallel for default(shared) schedule(static) reduction(max : term_max, res_max) reduction(|| : diverged)
+        for (std::size_t y = 0; y < n; ++y) {
+            accumulator_type v = 0;
+            for (I k = row_begin[y]; k < row_begin[y + 1]; ++k) {
+                v += static_cast<accumulator_type>(values[k]) * term[cols[k]];
+            }
+            next_term[y] = v;
+            res[y] += v;
+            term_max = std::max(term_max, std::abs(v));
+            res_max = std::max(res_max, std::abs(res[y]));
+            diverged = diverged || !std::isfinite(static_cast<T>(res[y]));
+        }
+        if (diverged) {
+            throw std::runtime_error("Power series diverged, A is not productive");
+        }
+        term.swap(next_term);
+        if (term_max <= tolerance * res_max) {
+            return std::vector<T>(std::begin(res), std::end(res));
+        }
+    }
+    throw std::runtime_error("Power series did not converge within " + std::to_string(max_iterations) + " iterations");
+}
+
+template<typename T, typename I>
+Table<T, I> leontief(const Table<T, I>& table, const settings::SettingsNode& settings_node) {
+    const auto& index_set = table.index_set();
+    std::vector<T> final_demand(index_set.size(), 0);
+    const auto& filename = settings_node["final_demand"].as<std::string>();
+    {
+        std::ifstream file(filename);
+        if (!file) {
+            throw std::runtime_error("Could not open final demand file " + filename);
+        }
+        try {
+            csv::Parser in(file);
+            do {
+                const auto c = in.read<std::string, std::string, T>();
+                const Sector<I>* sector = index_set.find_sector(std::get<0>(c));
+                const Region<I>* region = index_set.find_region(std::get<1>(c));
+                if (!sector || !region) {
+                    throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " not found");
+                }
+                if (sector->has_sub() || region->has_sub()) {
+                    throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " has subs, use the sub indices instead");
+                }
+                const I index = index_set(sector, region);
+                if (index == IndexSet<I>::NOT_GIVEN) {
+                    throw std::runtime_error("Index " + std::get<0>(c) + ":" + std::get<1>(c) + " from " + filename + " not found");
+                }
+                final_demand[index] = std::get<2>(c);
+            } while (in.next_row());
+        } catch (const csv::parser_exception& ex) {
+            throw std::runtime_error(ex.format(filename));
+        }
+    }
+    const auto coefficients = technical_coefficients(table, final_demand);
+    if (settings_node.has("solution")) {
+        const auto& solution_filename = settings_node["solution"].as<std::string>();
+        const auto solution = leontief_solve(coefficients, final_demand, settings_node["tolerance"].as<T>(1e-9), settings_node["max_iterations"].as<I>(1000));
+        std::ofstream file(solution_filename);
+        if (!file) {
+            throw std::runtime_error("Could not create solution file " + solution_filename);
+        }
+        for (const auto& index : index_set.permutation(IndexSet<I>::Order::REGION_MAJOR)) {
+            file << index_set.sector_of(index)->name << "," << index_set.region_of(index)->name << "," << solution[index] << '\n';
+        }
+    }
+    return leontief_inverse(coefficients);
+}
+
+template Table<double, std::size_t> technical_coefficients(const Table<double, std::size_t>& table, const std::vector<double>& final_demand);
+template Table<float, std::size_t> technical_coefficients(const Table<float, std::size_t>& table, const std::vector<float>& final_demand);
+template Table<double, std::size_t> leontief_inverse(const Table<double, std::size_t>& coefficients);
+template Table<float, std::size_t> leontief_inverse(const Table<float, std::size_t>& coefficients);
+template std::vector<double> leontief_solve(const Table<double, std::size_t>& coefficients,
+                                            const std::vector<double>& demand,
+                                            const double& tolerance,
+                                            const std::size_t& max_iterations);
+template std::vector<float> leontief_solve(const Table<float, std::size_t>& coefficients,
+                                           const std::vector<float>& demand,
+                                           const float& tolerance,
+                                           const std::size_t& max_iterations);
+template Table<double, std::uint32_t> technical_coefficients(const Table<double, std::uint32_t>& table, const std::vector<double>& final_demand);
+template Table<float, std::uint32_t> technical_coefficients(const Table<float, std::uint32_t>& table, const std::vector<float>& final_demand);
+template Table<double, std::uint32_t> leontief_inverse(const Table<double, std::uint32_t>& coefficients);
+template Table<float, std::uint32_t> leontief_inverse(const Table<float, std::uint32_t>& coefficients);
+template std::vector<double> leontief_solve(const Table<double, std::uint32_t>& coefficients,
+                                            const std::vector<double>& demand,
+                                            const double& tolerance,
+                                            const std::uint32_t& max_iterations);
+template std::vector<float> leontief_solve(const Table<float, std::uint32_t>& coefficients,
+                                           const std::vector<float>& demand,
+                                           const float& tolerance,
+                                           const std::uint32_t& max_iterations);
+template Table<double, std::size_t> leontief(const Table<double, std::size_t>& table, const settings::SettingsNode& settings_node);
+template Table<float, std::size_t> leontief(const Table<float, std::size_t>& table, const settings::SettingsNode& settings_node);
+template Table<double, std::uint32_t> leontief(const Table<double, std::uint32_t>& table, const settings::SettingsNode& settings_node);
+template Table<float, std::uint32_t> leontief(const Table<float, std::uint32_t>& table, const settings::SettingsNode& settings_node);
+
+}  // namespace mrio
@@ -18,6 +18,8 @@
 */
 
 #include <fenv.h>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <fstream>  // IWYU pragma: keep
 #include <iostream>
@@ -27,7 +29,11 @@
 #include <iomanip>
 #endif
 #include "MRIOTable.h"
+#include "affinity.h"
+#include "aggregation.h"
+#include "allocator.h"
 #include "disaggregation.h"
+#include "leontief.h"
 #ifdef LIBMRIO_SHOW_PROGRESS
 #include "progressbar.h"
 #endif
@@ -35,10 +41,6 @@
 #include "settingsnode/yaml.h"
 #include "version.h"
 
-// Define types used in templates
-using I = std::size_t;  // Index type
-using T = double;       // Data type
-
 static void print_usage(const char* program_name) {
     std::cerr << "Regional and sectoral disaggregation of multi-regional input-output tables\n"
                  "Version:  "
@@ -64,6 +66,74 @@ static void print_usage(const char* program_name) {
               << std::endl;
 }
 
+template<typename T, typename I>
+static void run(const settings::SettingsNode& settings) {
+    mrio::Table<T, I> basetable;
+    {
+#ifdef LIBMRIO_SHOW_PROGRESS
+        progressbar::ProgressBar bar(1, "Load basetable");
+#endif
+        const std::string& type = settings["basetable"]["type"].as<std::string>();
+        const std::string& filename = settings["basetable"]["file"].as<std::string>();
+        const auto threshold = settings["basetable"]["threshold"].as<T>();
+        if (type == "csv") {
+            std::ifstream indices(settings["basetable"]["index"].as<std::string>());
+            if (!indices) {
+                throw std::runtime_error("Could not open indices file");
+            }
+            std::ifstream data(filename);
+            if (!data) {
+                throw std::runtime_error("Could not open data file");
+            }
+            basetable.read_from_csv(indices, data, threshold);
+#ifdef LIBMRIO_WITH_NETCDF
+        } else if (type == "netcdf") {
+            basetable.read_from_netcdf(filename, threshold);
+#endif
+        } else {
+            throw std::runtime_error("Unknown type '" + type + "'");
+        }
+#ifdef LIBMRIO_SHOW_PROGRESS
+        ++bar;
+#endif
+    }
+
+    auto refined_table = disaggregate(basetable, settings["disaggregation"]);
+    if (settings.has("aggregation")) {
+        refined_table = aggregate(refined_table, settings["aggregation"]);
+    }
+    if (settings.has("leontief")) {
+        refined_table = leontief(refined_table, settings["leontief"]);
+    }
+    {
+#ifdef LIBMRIO_SHOW_PROGRESS
+        progressbar::ProgressBar bar(1, "Write output table");
+#endif
+        const std::string& type = settings["output"]["type"].as<std::string>();
+        const std::string& filename = settings["output"]["file"].as<std::string>();
+        if (type == "csv") {
+            std::ofstream data(filename);
+            if (!data) {
+                throw std::runtime_error("Could not create data output file");
+            }
+            std::ofstream indices(settings["output"]["index"].as<std::string>());
+            if (!indices) {
+                throw std::runtime_error("Could not create indices output file");
+            }
+            refined_table.write_to_csv(indices, data, settings["output"]["region_major"].as<bool>(true));
+#ifdef LIBMRIO_WITH_NETCDF
+        } else if (type == "netcdf") {
+            refined_table.write_to_netcdf(filename);
+#endif
+        } else {
+            throw std::runtime_error("Unknown type '" + type + "'");
+        }
+#ifdef LIBMRIO_SHOW_PROGRESS
+        ++bar;
+#endif
+    }
+}
+
 int main(int argc, char* argv[]) {
 #ifndef DEBUG
     try {
@@ -100,67 +170,47 @@ int main(int argc, char* argv[]) {
                 feenableexcept(FE_DIVBYZERO);
             }
 
+            mrio::set_huge_pages(settings["huge_pages"].as<bool>(false));
+
+            const auto& thread_affinity = settings["thread_affinity"].as<std::string>("none");
+            if (thread_affinity == "close") {
+                mrio::set_thread_affinity(mrio::ThreadAffinity::CLOSE);
+            } else if (thread_affinity == "spread") {
+                mrio::set_thread_affinity(mrio::ThreadAffinity::SPREAD);
+            } else if (thread_affinity != "none") {
+                throw std::runtime_error("Unknown thread affinity '" + thread_affinity + "'");
+            }
+            const auto& memory_policy = settings["memory_policy"].as<std::string>("first_touch");
+            if (memory_policy == "interleave") {
+                mrio::set_memory_policy(mrio::MemoryPolicy::INTERLEAVE);
+            } else if (memory_policy != "first_touch") {
+                throw std::runtime_error("Unknown memory policy '" + memory_policy + "'");
+            }
+
 #ifdef LIBMRIO_VERBOSE
             std::cout << std::setprecision(3) << std::fixed;
 #endif
 
-            mrio::Table<T, I> basetable;
-            {
-#ifdef LIBMRIO_SHOW_PROGRESS
-                progressbar::ProgressBar bar(1, "Load basetable");
-#endif
-                const std::string& type = settings["basetable"]["type"].as<std::string>();
-                const std::string& filename = settings["basetable"]["file"].as<std::string>();
-                const auto threshold = settings["basetable"]["threshold"].as<T>();
-                if (type == "csv") {
-                    std::ifstream indices(settings["basetable"]["index"].as<std::string>());
-                    if (!indices) {
-                        throw std::runtime_error("Could not open indices file");
-                    }
-                    std::ifstream data(filename);
-                    if (!data) {
-                        throw std::runtime_error("Could not open data file");
-                    }
-                    basetable.read_from_csv(indices, data, threshold);
-#ifdef LIBMRIO_WITH_NETCDF
-                } else if (type == "netcdf") {
-                    basetable.read_from_netcdf(filename, threshold);
-#endif
+            const auto& precision = settings["precision"].as<std::string>("double");
+            const auto& index_type = settings["index_type"].as<std::string>("size_t");
+            if (index_type == "size_t") {
+                if (precision == "double") {
+                    run<double, std::size_t>(settings);
+                } else if (precision == "float") {
+                    run<float, std::size_t>(settings);
                 } else {
-                    throw std::runtime_error("Unknown type '" + type + "'");
+                    throw std::runtime_error("Unknown precision '" + precision + "'");
                 }
-#ifdef LIBMRIO_SHOW_PROGRESS
-                ++bar;
-#endif
-            }
-
-            auto refined_table = disaggregate(basetable, settings["disaggregation"]);
-            {
-#ifdef LIBMRIO_SHOW_PROGRESS
-                progressbar::ProgressBar bar(1, "Write output table");
-#endif
-                const std::string& type = settings["output"]["type"].as<std::string>();
-                const std::string& filename = settings["output"]["file"].as<std::string>();
-                if (type == "csv") {
-                    std::ofstream data(filename);
-                    if (!data) {
-                        throw std::runtime_error("Could not create data output file");
-                    }
-                    std::ofstream indices(settings["output"]["index"].as<std::string>());
-                    if (!indices) {
-                        throw std::runtime_error("Could not create indices output file");
-                    }
-                    refined_table.write_to_csv(indices, data);
-#ifdef LIBMRIO_WITH_NETCDF
-                } else if (type == "netcdf") {
-                    refined_table.write_to_netcdf(filename);
-#endif
+            } else if (index_type == "uint32") {
+                if (precision == "double") {
+                    run<double, std::uint32_t>(settings);
+                } else if (precision == "float") {
+                    run<float, std::uint32_t>(settings);
                 } else {
-                    throw std::runtime_error("Unknown type '" + type + "'");
+                    throw std::runtime_error("Unknown precision '" + precision + "'");
                 }
-#ifdef LIBMRIO_SHOW_PROGRESS
-                ++bar;
-#endif
+            } else {
+                throw std::runtime_error("Unknown index type '" + index_type + "'");
             }
         }
 #ifndef DEBUG
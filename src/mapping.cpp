@@ -0,0 +1,101 @@
+/*
+  Copyright (C) 2014-2017 Sven Willner <sven.willner@pik-potsdam.de>
+
+  This file is part of libmrio.
+
+  libmrio is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of
+  the License, or (at your option) any later version.
+
+  libmrio is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with libmrio.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mapping.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "csv-parser.h"
+#include "settingsnode.h"
+
+namespace mrio {
+
+void read_mapping_from_file(const settings::SettingsNode& mapping_node,
+                            const std::function<void(const std::string& foreign_id, const std::string& native_id)>& func) {
+    const auto& filename = mapping_node["file"].as<std::string>();
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open mapping file " + filename);
+    }
+    try {
+        csv::Parser in(file);
+        std::size_t foreign_column = 0;
+        std::size_t native_column = 0;
+        {
+            bool foreign_column_found = false;
+            bool native_column_found = false;
+            const auto& foreign_column_name = mapping_node["foreign_column"].as<std::string>();
+            const auto& native_column_name = mapping_node["native_column"].as<std::string>();
+            std::size_t i = 0;
+            do {
+                const auto& name = in.read<std::string>();
+                if (name == foreign_column_name) {
+                    foreign_column = i;
+                    foreign_column_found = true;
+                    if (native_column_found) {
+                        break;
+                    }
+                } else if (name == native_column_name) {
+                    native_column = i;
+                    native_column_found = true;
+                    if (foreign_column_found) {
+                        break;
+                    }
+                }
+                ++i;
+            } while (in.next_col());
+            if (!foreign_column_found) {
+                throw std::runtime_error("Column " + foreign_column_name + " not found in " + filename);
+            }
+            if (!native_column_found) {
+                throw std::runtime_error("Column " + native_column_name + " not found in " + filename);
+            }
+        }
+
+        while (in.next_row()) {
+            for (std::size_t i = 0; i < std::min(foreign_column, native_column); ++i) {
+                in.next_col();
+            }
+            auto a = in.read_and_next<std::string>();
+            if (a == "-") {
+                continue;
+            }
+            for (std::size_t i = std::min(foreign_column, native_column) + 1; i < std::max(foreign_column, native_column); ++i) {
+                in.next_col();
+            }
+            auto b = in.read_and_next<std::string>();
+            if (b == "-") {
+                continue;
+            }
+            if (foreign_column < native_column) {
+                func(a, b);
+            } else {
+                func(b, a);
+            }
+        }
+    } catch (const csv::parser_exception& ex) {
+        throw std::runtime_error(ex.format(filename));
+    }
+}
+
+}  // namespace mrio
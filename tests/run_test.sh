@@ -1,8 +1,18 @@
-#!/bin/sh -e
-if "$@" settings.yml
+#!/bin/sh
+# set here, as the shebang flag is ignored when run as "sh run_test.sh"
+set -e
+# a test either expects the error message in expected_error.txt or the output files matching correct_*.csv
+if [ -f expected_error.txt ]
 then
-    diff output_indices.csv correct_indices.csv
-    diff output_data.csv correct_data.csv
+    if "$@" settings.yml 2> output_error.txt
+    then
+        exit 1
+    fi
+    grep -qF -f expected_error.txt output_error.txt
 else
-    return 1
+    "$@" settings.yml
+    for correct in correct_*.csv
+    do
+        diff "output_${correct#correct_}" "$correct"
+    done
 fi